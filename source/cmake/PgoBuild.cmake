@@ -0,0 +1,70 @@
+# Profile guided build of the scan, run by the pgo target with cmake -P
+#
+# 1. configure and build BINARY_DIR instrumented (PIXIE_PGO=GENERATE)
+# 2. run the training: the scan on TRAINING_LDF if set, otherwise the
+#    benchmark with BENCH_ARGS, in TRAINING_DIR which holds map.txt/cal.txt
+# 3. reconfigure the same directory with PIXIE_PGO=USE and rebuild, the
+#    objects keep their paths so gcc finds their profiles
+#
+# The profiles are removed first, so that the result only depends on the
+# sources and the training set.
+
+foreach(var SOURCE_DIR BINARY_DIR GENERATOR CXX_COMPILER TRAINING_DIR)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "PgoBuild.cmake needs -D${var}=...")
+  endif()
+endforeach()
+
+set(profileDir ${BINARY_DIR}/pgo-data)
+string(REPLACE "|" ";" TRAINING_LDF "${TRAINING_LDF}")
+if(TRAINING_LDF AND USE_HHIRF)
+  message(FATAL_ERROR "scanor can't replay .ldf files unattended, train the "
+    "HHIRF build on the benchmark or build without PIXIE_USE_HHIRF")
+endif()
+
+macro(run step)
+  execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "PGO ${step} failed: ${result}")
+  endif()
+endmacro()
+
+macro(configure_and_build mode)
+  run("configure (${mode})" ${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${BINARY_DIR}
+    -G ${GENERATOR}
+    -DCMAKE_CXX_COMPILER=${CXX_COMPILER}
+    -DCMAKE_BUILD_TYPE=Release
+    -DPIXIE_NATIVE=${NATIVE} -DPIXIE_LTO=${LTO}
+    -DPIXIE_REVD=${REVD} -DPIXIE_REVF=${REVF} -DPIXIE_BLINDED=${BLINDED}
+    -DPIXIE_USE_HHIRF=${USE_HHIRF}
+    -DPIXIE_PGO=${mode} -DPIXIE_PGO_DIR=${profileDir})
+  run("build (${mode})" ${CMAKE_COMMAND} --build ${BINARY_DIR})
+endmacro()
+
+file(REMOVE_RECURSE ${profileDir})
+configure_and_build(GENERATE)
+
+if(TRAINING_LDF)
+  message(STATUS "PGO training on ${TRAINING_LDF}")
+  run("training" ${BINARY_DIR}/pixie_ldf_c_slim -o ${BINARY_DIR}/training
+    ${TRAINING_LDF} WORKING_DIRECTORY ${TRAINING_DIR} OUTPUT_QUIET)
+  file(REMOVE ${BINARY_DIR}/training.drr ${BINARY_DIR}/training.his)
+else()
+  separate_arguments(benchArgs UNIX_COMMAND "${BENCH_ARGS}")
+  message(STATUS "PGO training on pixie_bench ${BENCH_ARGS}")
+  run("training" ${BINARY_DIR}/pixie_bench ${benchArgs}
+    WORKING_DIRECTORY ${TRAINING_DIR} OUTPUT_QUIET)
+endif()
+
+if(CXX_COMPILER_ID MATCHES "Clang")
+  find_program(PROFDATA NAMES llvm-profdata)
+  if(NOT PROFDATA)
+    message(FATAL_ERROR "llvm-profdata is needed to merge the clang profiles")
+  endif()
+  file(GLOB rawProfiles ${profileDir}/*.profraw)
+  run("profile merge" ${PROFDATA} merge -o ${profileDir}/default.profdata
+    ${rawProfiles})
+endif()
+
+configure_and_build(USE)
+message(STATUS "PGO build in ${BINARY_DIR}")
@@ -0,0 +1,105 @@
+/*! \file ChainCorrelator.h
+ *  \brief Time-ordered correlation of tagged events
+ *
+ *  Class which correlates an event with earlier tagged events (betas,
+ *  implants, gammas, neutron-gated events) recorded at the same location
+ */
+
+#ifndef __CHAIN_CORRELATOR_H_
+#define __CHAIN_CORRELATOR_H_
+
+#include <deque>
+#include <map>
+#include <queue>
+#include <vector>
+
+/*!
+  \brief correlate events with earlier tagged events in time windows
+
+  Every tagged event is stored with its time and energy in a time-ordered
+  queue kept per location and per tag. Locations are arbitrary keys (a
+  pixel, a strip pair, 0 for the whole detector). Since the queues are
+  sorted, the events falling into a correlation window are found by a binary
+  search, and events older than the longest window are expired from the front
+  of the queue, so the cost per event does not depend on the rate. All events
+  are also kept in a heap by time, so that the expiry only visits the
+  locations holding an expired event and not every location.
+
+  Two windows are kept: the correlation window and a background window of
+  the same width placed far from the trigger, which samples the random
+  coincidences to be subtracted from the correlated spectra. Window limits
+  are times elapsed since the tagged event, in seconds.
+*/
+class ChainCorrelator
+{
+ public:
+  /// tags of the events kept by the correlator
+  enum ETag{BETA_TAG, IMPLANT_TAG, GAMMA_TAG, NEUTRON_TAG, NUM_TAGS};
+
+  /// a tagged event
+  struct Entry
+  {
+    double time;   ///< time of the event in seconds
+    double energy; ///< energy of the event
+
+    Entry(double t = -1., double e = 0.) : time(t), energy(e) {}
+  };
+
+  /// window of time elapsed since a tagged event, (begin, end) in seconds
+  struct Window
+  {
+    double begin;
+    double end;
+
+    Window(double b = 0., double e = 0.) : begin(b), end(e) {}
+    double Width(void) const {return end - begin;}
+  };
+
+  ChainCorrelator();
+
+  void SetWindow(const Window &w);
+  void SetBackgroundWindow(const Window &w);
+  const Window& GetWindow(void) const {return window;}
+  const Window& GetBackgroundWindow(void) const {return bkgWindow;}
+
+  void Add(unsigned long location, ETag tag, double time, double energy = 0.);
+  unsigned Correlate(unsigned long location, ETag tag, double time,
+		     std::vector<Entry> &found, bool background = false) const;
+  unsigned Count(unsigned long location, ETag tag, double time,
+		 bool background = false) const;
+  const Entry* Last(unsigned long location, ETag tag, double time) const;
+
+  void Expire(double time);
+  void Clear(void);
+  unsigned long GetSize(void) const;
+
+ private:
+  typedef std::deque<Entry> Queue;
+  /// queues of all tags at a single location
+  struct Lane
+  {
+    Queue queue[NUM_TAGS];
+  };
+
+  /// an added event, kept to find the locations to expire
+  struct Expiry
+  {
+    double time;
+    unsigned long location;
+
+    Expiry(double t, unsigned long l) : time(t), location(l) {}
+    /// the heap has the earliest event on top
+    bool operator<(const Expiry &e) const {return time > e.time;}
+  };
+
+  std::map<unsigned long, Lane> lanes; ///< tagged events at each location
+  std::priority_queue<Expiry> expiry;  ///< all events, earliest first
+  Window window;    ///< correlation window
+  Window bkgWindow; ///< random coincidence background window
+  double maxAge;    ///< events older than this are expired
+
+  const Queue* GetQueue(unsigned long location, ETag tag) const;
+  void UpdateMaxAge(void);
+};
+
+#endif // __CHAIN_CORRELATOR_H_
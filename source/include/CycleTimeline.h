@@ -0,0 +1,78 @@
+/** \file CycleTimeline.h
+ *  \brief Timeline of the tape cycle built from the logic signals
+ *
+ *  All logic transitions of a run are indexed as they are read from the
+ *  data, before the events are built, so that the cycle state of any event
+ *  can be looked up by its time independently of the processing order.
+ */
+
+#ifndef __CYCLE_TIMELINE_H_
+#define __CYCLE_TIMELINE_H_
+
+#include <vector>
+
+class ChanEvent;
+class Identifier;
+
+/**
+ * \brief Sorted list of logic transitions with the cycle state after each
+ */
+class CycleTimeline {
+ public:
+    /// logic signals, the values match the logic signals plot in MtasProcessor
+    enum ESignal {TRIGGER = 1,
+		  IRRAD_ON = 2, IRRAD_OFF = 4,
+		  LIGHT_PULSER_ON = 8, LIGHT_PULSER_OFF = 16,
+		  TAPE_MOVE_ON = 32, TAPE_MOVE_OFF = 64,
+		  BKG_ON = 128, BKG_OFF = 256,
+		  MEASURE_ON = 512, MEASURE_OFF = 1024};
+
+    /// state of the cycle
+    struct CycleState {
+	unsigned cycleNumber;  ///< number of triggers seen so far
+	double measureOnTime;  ///< time of the last trigger in s, -1 if none
+	bool isTapeMoveOn;
+	bool isMeasureOn;
+	bool isBkgOn;
+	bool isLightPulserOn;
+	bool isIrradOn;
+
+	CycleState();
+	/** time elapsed since the start of the cycle, -1 if no cycle started */
+	double TimeInCycle(double time) const {
+	    return measureOnTime < 0 ? -1. : time - measureOnTime;
+	}
+    };
+
+    CycleTimeline();
+
+    void Init(const std::vector<Identifier> &modChan);
+    void Index(const ChanEvent *chan);
+    void Add(double time, unsigned signal);
+    const CycleState& Query(double time) const;
+    void Clear(void);
+
+    unsigned GetSignal(int id) const;
+    size_t GetSize(void) const {return transitions.size();}
+
+ private:
+    /// a logic signal and the state of the cycle once it is applied
+    struct Transition {
+	double time;
+	unsigned signal;
+	CycleState state;
+    };
+
+    static const double logicThreshold; ///< minimum raw energy of a signal
+    static const double resetTime;      ///< time jump back meaning a new run
+
+    std::vector<Transition> transitions; ///< transitions ordered by time
+    std::vector<unsigned> signalOfId;    ///< logic signal of each channel id
+    CycleState initial;                  ///< state before the first transition
+
+    void Rebuild(size_t from);
+    static void Apply(CycleState &state, unsigned signal, double time,
+		      bool verbose);
+};
+
+#endif // __CYCLE_TIMELINE_H_
@@ -0,0 +1,73 @@
+/** \file DammBackend.h
+ *  \brief DAMM histograms kept in process, for building without HHIRF
+ *
+ *  The hd1d_, hd2d_, drrmake_, endrr_, count1cc_, set2cc_ and inc2cc_ entry
+ *  points are implemented here with the semantics of the upak ones:
+ *  parameters are compressed by the raw to histogram length ratio, values
+ *  outside [min, max] are dropped and channels are one (16 bit) or two (32
+ *  bit) half-words. At the end of the scan the histograms are written as a
+ *  .drr directory and .his data file which damm opens as usual.
+ */
+
+#ifndef __DAMM_BACKEND_H_
+#define __DAMM_BACKEND_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * \brief Histogram memory and directory of the DAMM back end
+ */
+class DammBackend {
+ public:
+    /// a declared histogram, as in a .drr entry
+    struct Histogram {
+	int id;
+	short dim;          ///< 1 or 2
+	short halfWords;    ///< per channel, 1 or 2
+	int raw[2];         ///< parameter length
+	int scaled[2];      ///< histogram length
+	int min[2];         ///< first channel after compression
+	int max[2];         ///< last channel after compression
+	int shift[2];       ///< compression, log2(raw / scaled)
+	int length[2];      ///< max - min + 1
+	int offset;         ///< in half-words from the start of the .his
+	std::string title;
+    };
+
+    DammBackend();
+
+    void Make(void);
+    void Declare(int id, int dim, int halfWords, const int *raw,
+		 const int *scaled, const int *min, const int *max,
+		 const char *title, int titleLength);
+    void End(void);
+
+    void Count(int id, int x, int y);
+    void Set(int id, int x, int y, int z);
+    void Increment(int id, int x, int y, int z);
+    int Get(int id, int x, int y = 0) const;
+
+    bool Write(const std::string &baseName) const;
+
+    size_t GetNumHistograms(void) const {return order.size();}
+    size_t GetHalfWords(void) const {return memory.size();}
+
+ private:
+    static const int maxId = 8000; ///< size of the DAMM id tables
+
+    std::vector<Histogram> histograms; ///< indexed by id, dim 0 if not declared
+    std::vector<int> order;            ///< ids in declaration order
+    std::vector<uint16_t> memory;      ///< all channels, as in the .his file
+
+    uint16_t* Channel(int id, int x, int y);
+    const uint16_t* Channel(int id, int x, int y) const;
+    static int64_t GetValue(const Histogram &his, const uint16_t *chan);
+    static void SetValue(const Histogram &his, uint16_t *chan, int64_t value);
+};
+
+extern DammBackend damm;
+
+#endif // __DAMM_BACKEND_H_
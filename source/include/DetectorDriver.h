@@ -13,11 +13,15 @@
 #ifndef __DETECTORDRIVER_H_
 #define __DETECTORDRIVER_H_ 1
 
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "CycleTimeline.h"
+#include "TimingEngine.h"
 #include "TraceAnalyzer.h"
+#include "TraceFile.h"
 #include "param.h"
 
 // forward declarations
@@ -26,6 +30,7 @@ class RawEvent;
 class ChanEvent;
 class EventProcessor;
 
+using std::map;
 using std::set;
 using std::string;
 using std::vector;
@@ -45,16 +50,29 @@ class DetectorDriver {
 				   energy and time information */
     set<string> knownDetectors; /**< list of valid detectors that can 
 				   be used as detector types */
+    map<string, unsigned> traceProducts; /**< trace analysis products needed
+					    by the processors of each type */
+    unsigned shedLevel;         /**< how much work is skipped while the
+				   live analysis is behind, 0 for none */
  public:    
     vector<Calibration> cal;    /**<the calibration vector*/ 
+    CycleTimeline cycles;       /**< tape cycle timeline indexed from the
+				   logic signals of each spill */
+    TimingEngine timing;        /**< high resolution time of each channel */
+    TraceFile traceFile;        /**< traces saved with PIXIE_TRACE_FILE */
     
     int ProcessEvent(const string &);
     int ThreshAndCal(ChanEvent *);
+    int AnalyzeTrace(ChanEvent *, unsigned);
+    void ClassifyPileup(ChanEvent *);
     int Init(void);
     int PlotRaw(const ChanEvent *) const;
     int PlotCal(const ChanEvent *) const;
     const set<string>& GetKnownDetectors(void);
     const set<string>& GetUsedDetectors(void) const;
+    unsigned SetBacklog(double fill);
+    unsigned GetShedLevel(void) const {return shedLevel;}
+    static const unsigned maxShedLevel = 3;
 
     void DeclarePlots(void) const; /**< declare the necessary damm plots */
     bool SanityCheck(void) const;  /**< check whether everything makes sense */
@@ -0,0 +1,65 @@
+/** \file EventHistory.h
+ *  \brief Sliding window of recently built events
+ *
+ *  Keeps the last N built events (time, beta flag, ring energies) in a ring
+ *  buffer so that inter-event time-difference analyses can look back at
+ *  previous events instead of remembering a single one in globals.
+ */
+
+#ifndef __EVENT_HISTORY_H_
+#define __EVENT_HISTORY_H_
+
+#include <vector>
+
+/**
+ * \brief Summary of a single built event
+ */
+struct EventRecord {
+    static const unsigned numEnergies = 5; ///< 0 - total, 1 - C, 2 - I, 3 - M, 4 - O
+
+    double time;                 ///< event time in seconds
+    bool isBeta;                 ///< true if the event had a beta signal
+    double energy[numEnergies];  ///< ring energies of the event
+};
+
+/**
+ * \brief Ring buffer of the last N events ordered in time
+ *
+ * Records are indexed from the oldest (0) to the newest (Size()-1). Since
+ * events are appended in time order, a window query starts with a binary
+ * search, O(log N), and then walks the k records in the window, so
+ * CountInWindow() and FirstInWindow() cost O(log N + k). The most recent
+ * beta is tracked on insertion and costs O(1).
+ */
+class EventHistory {
+ public:
+    /** Selection of records for the window queries */
+    enum ESelect {ANY, BETA, NOT_BETA};
+
+    EventHistory(unsigned capacity = 256);
+
+    void Add(double time, bool isBeta, const std::vector<double> &energy);
+    void Clear(void);
+
+    unsigned Size(void) const {return size;}
+    unsigned Capacity(void) const {return records.size();}
+    bool Empty(void) const {return size == 0;}
+
+    const EventRecord& At(unsigned i) const;
+    const EventRecord& Back(unsigned n = 0) const;
+    const EventRecord* LastBeta(void) const;
+
+    unsigned LowerBound(double t) const;
+    unsigned CountInWindow(double t1, double t2, ESelect select = ANY) const;
+    const EventRecord* FirstInWindow(double t1, double t2, ESelect select = ANY) const;
+ private:
+    std::vector<EventRecord> records; ///< storage for the ring
+    unsigned head;                    ///< position of the oldest record
+    unsigned size;                    ///< number of valid records
+    unsigned long added;              ///< total number of records added
+    unsigned long lastBeta;           ///< value of added after the last beta
+
+    static bool Selected(const EventRecord &rec, ESelect select);
+};
+
+#endif // __EVENT_HISTORY_H_
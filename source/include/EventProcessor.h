@@ -11,7 +11,7 @@
 #include <set>
 #include <string>
 
-#include <sys/times.h>
+#include <stdint.h>
 
 // forward declarations
 class DetectorDriver;
@@ -23,12 +23,16 @@ class TTree;
 #endif
 
 class EventProcessor {
+ public:
+    // how much the processor matters when the live analysis sheds load
+    enum EPriority {PRIORITY_ESSENTIAL, PRIORITY_NORMAL, PRIORITY_LOW};
+    // rough cost of the processor per event
+    enum ECost {COST_LOW, COST_HIGH};
+
  private:
     // things associated with timing
-    tms tmsBegin;
-    double userTime;
-    double systemTime;
-    double clocksPerSecond;
+    unsigned profileStage; ///< stage of this processor in the profiler
+    uint64_t processBegin; ///< start of the current Process() call in ns
 
 
  protected:
@@ -37,6 +41,13 @@ class EventProcessor {
     std::set<std::string> associatedTypes;    
     bool initDone;
     bool didProcess;
+    // what may be skipped while the live analysis is behind
+    EPriority priority;
+    ECost cost;
+    unsigned long skipped; // events skipped to shed load
+    // trace analysis products (TraceAnalyzer::ETraceProduct) needed for
+    // the associated types
+    unsigned traceProducts;
     // map of associated detector summary
     std::map<std::string, const DetectorSummary *> sumMap;
 
@@ -52,6 +63,22 @@ class EventProcessor {
     virtual bool DidProcess(void) const {
       return didProcess;
     }
+    virtual unsigned GetTraceProducts(void) const {
+      return traceProducts;
+    }
+    EPriority GetPriority(void) const {
+      return priority;
+    }
+    ECost GetCost(void) const {
+      return cost;
+    }
+    unsigned GetShedLevel(void) const;
+    void Skip(void) {
+      skipped++;
+    }
+    unsigned long GetSkipped(void) const {
+      return skipped;
+    }
     // return true on success
     virtual bool HasEvent(void) const;
     virtual bool Init(DetectorDriver &driver);
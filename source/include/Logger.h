@@ -0,0 +1,115 @@
+/** \file Logger.h
+ *  \brief Rate limited diagnostics written by a thread of their own
+ *
+ *  The diagnostics of the readout and the processors are logged through
+ *  PIXIE_LOG() instead of cout. Every place logging a message is a site,
+ *  which counts how often it fired and lets the first few messages through
+ *  before limiting itself to one message per second, each telling how many
+ *  were suppressed meanwhile. The messages are formatted at the site but
+ *  written and flushed by the logging thread, so a corrupted run does not
+ *  make the scan wait on the terminal. At the end of the run the sites that
+ *  fired are summarized with their counts.
+ *
+ *  PIXIE_LOG_LEVEL (debug, info, warning or error) sets the least severe
+ *  messages written, the others are still counted. PIXIE_LOG_FILE sends
+ *  the messages to a file instead of the standard output.
+ */
+
+#ifndef __LOGGER_H_
+#define __LOGGER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * \brief Severity levels, rate limits and the asynchronous sink
+ */
+class Logger {
+ public:
+    enum ESeverity {DEBUG, INFO, WARNING, ERROR, NUM_SEVERITIES};
+
+    /// messages of a site written before it is rate limited
+    static const unsigned burst = 10;
+    /// at most one message per site in this many ns once limited
+    static const uint64_t limitInterval = 1000000000ull;
+    /// messages waiting to be written before new ones are dropped
+    static const size_t maxQueued = 10000;
+
+    /// a place in the code logging one kind of message
+    class Site {
+    public:
+	Site(ESeverity severity, const char *name);
+
+	ESeverity GetSeverity(void) const {return severity;}
+	const char* GetName(void) const {return name;}
+	uint64_t GetCount(void) const {return count.load(std::memory_order_relaxed);}
+
+    private:
+	friend class Logger;
+
+	ESeverity severity;
+	const char *name;           ///< short description for the summary
+	std::atomic<uint64_t> count;///< times the site fired
+	uint64_t written;           ///< messages let through
+	uint64_t suppressed;        ///< messages held back since the last one written
+	uint64_t lastWrite;         ///< time of the last message written
+    };
+
+    Logger();
+    ~Logger();
+
+    bool Allow(Site &site);
+    void Write(Site &site, const std::string &message);
+    void Flush(void);
+    void Report(std::ostream &out);
+
+    ESeverity GetLevel(void) const {return level;}
+    static bool ParseSeverity(const std::string &name, ESeverity &severity);
+    static const char* GetSeverityName(ESeverity severity);
+
+ private:
+    ESeverity level;               ///< least severe messages written
+    std::vector<Site*> sites;      ///< sites which fired, for the summary
+    std::deque<std::string> queue; ///< messages for the logging thread
+    uint64_t queueDropped;         ///< messages lost with a full queue
+    size_t writing;                ///< messages taken by the thread, not yet written
+    bool stop;
+
+    std::ofstream file;
+    std::ostream *sink;            ///< the standard output or file
+
+    mutable std::mutex logMutex;
+    std::condition_variable notEmpty;
+    std::condition_variable flushed;
+    std::thread worker;
+
+    void Start(void);
+    void Stop(void);
+    void Work(void);
+};
+
+extern Logger logger; ///< logger of the whole scan, in PixieStd.cpp
+
+/** Log the message (anything which can be streamed, e.g. "a " << b) with
+ *  the severity (DEBUG, INFO, WARNING or ERROR) at a site named site */
+#define PIXIE_LOG(severity, site, message)				\
+    do {								\
+	static Logger::Site logSite_(Logger::severity, site);		\
+	if (logger.Allow(logSite_)) {					\
+	    std::ostringstream logStream_;				\
+	    logStream_ << message;					\
+	    logger.Write(logSite_, logStream_.str());			\
+	}								\
+    } while (0)
+
+#endif // __LOGGER_H_
@@ -7,6 +7,10 @@
 #define __MTAS_PROCESSOR_H_
 
 #include "EventProcessor.h"
+#include "EventHistory.h"
+#include "ChainCorrelator.h"
+#include <map>
+#include <string>
 #include <vector>
 
 class DetectorSummary;
@@ -64,6 +68,9 @@ class MtasProcessor : public EventProcessor
 	bool isAll;
 
     public:
+	/// what to do with the MTAS channels classified as piled up
+	enum EPileupPolicy {PILEUP_KEEP, PILEUP_REJECT, PILEUP_RECOVER};
+
         MtasProcessor(); // no virtual c'tors
         virtual void DeclarePlots(void) const;
         virtual bool Process(RawEvent &event);
@@ -72,6 +79,9 @@ class MtasProcessor : public EventProcessor
  	bool GetIsMeasure(void) const {return isMeasureOn;}
  	bool GetIsBackground(void) const {return isBkgOn;}
 	unsigned GetCycleNumber(void) const {return cycleNumber;} 		    
+	void SetPileupPolicy(EPileupPolicy policy);
+	EPileupPolicy GetPileupPolicy(void) const {return pileupPolicy;}
+	static bool ParsePileupPolicy(const std::string &name, EPileupPolicy &policy);
     	
     private:
         void FillMtasMap();
@@ -84,7 +94,7 @@ class MtasProcessor : public EventProcessor
         double maxLocation; 
 	int nrOfCentralPMTs; 
 
-	void SetCycleState();
+	void SetCycleState(double time);
         /*
         void FillMtasEnergyVectors();*/
         void SetIfOnlyRingBool();
@@ -119,7 +129,16 @@ class MtasProcessor : public EventProcessor
 
         bool isBetaSignal;
         double betaTime;
+        EventHistory history; ///< previous measurement events for the time-difference plots
+        ChainCorrelator chains; ///< betas for the beta-delayed MTAS spectra
     	double maxSiliconSignal;
+
+	EPileupPolicy pileupPolicy; ///< keep by default, as before the classification
+	/// per channel sum of energy over first pulse energy and number of clean hits
+	std::map<int, std::pair<double, unsigned> > pileupGain;
+	static const unsigned minGainHits; ///< clean hits needed before recovering
+
+	bool ApplyPileupPolicy(ChanEvent *chan, MtasData &data);
 };
 
 #endif // __MTAS_PROCESSOR_H_
@@ -0,0 +1,73 @@
+/*! \file PixelCorrelator.h
+ *  \brief Header file for correlation on large pixel grids
+
+ *  Class which handles implant/decay correlations for position sensitive
+ *  detectors with a continuous position
+ */
+
+#ifndef __PIXEL_CORRELATOR_H_
+#define __PIXEL_CORRELATOR_H_
+
+#include <deque>
+#include <unordered_map>
+#include <utility>
+
+#include "Correlator.h"
+
+/*!
+  \brief correlate decays with previous implants on an arbitrary pixel grid
+
+  Positions are divided into a grid of nx %x ny pixels covering
+  [0, xRange) %x [0, yRange). Only pixels holding a live implant are stored,
+  in a hash table keyed by the pixel index, so the memory follows the number
+  of implants within the correlation time rather than the size of the grid.
+  Implants older than the correlation time are expired, and the number of
+  stored implants is bounded by maxImplants, dropping the oldest first. The
+  time order of the implants is compacted when the pixels implanted again
+  make it twice as long as the stored implants, so it is bounded as well.
+
+  A decay is correlated with the most recent implant found in its pixel or
+  in the neighbouring pixels within the given radius. The same conditions as
+  for the strip Correlator are reported; a decay without any implant left in
+  its neighbourhood is DECAY_TOO_LATE.
+*/
+class PixelCorrelator
+{
+ public:
+  PixelCorrelator(unsigned nx = 256, unsigned ny = 256,
+		  double xRange = 256., double yRange = 256.,
+		  unsigned radius = 1, size_t maxImplants = 65536);
+
+  void SetTimes(double minImplantTime, double correlationTime);
+
+  Correlator::EConditions Correlate(Correlator::EEventType type,
+				    double x, double y, double time);
+  double GetDecayTime(void) const {return decayTime;}
+  std::pair<unsigned, unsigned> GetImplantPixel(void) const;
+  size_t GetSize(void) const {return implants.size();}
+
+  void Expire(double time);
+  void Clear(void);
+
+ private:
+  std::unordered_map<unsigned, ImplantData> implants; ///< live implants by pixel
+  std::deque< std::pair<double, unsigned> > order; ///< implants in time order
+
+  unsigned nx, ny;    ///< size of the grid
+  double xScale;      ///< pixels per unit of x
+  double yScale;      ///< pixels per unit of y
+  unsigned radius;    ///< neighbourhood searched for implants
+  size_t maxImplants; ///< bound on the number of stored implants
+
+  // in units of pixie clocks
+  double minImpTime; ///< minimum time between implants in a pixel
+  double corrTime;   ///< maximum time between a decay and its implant
+
+  double decayTime;       ///< implant-decay time of the last valid decay
+  unsigned lastImplantKey; ///< pixel of the implant of the last valid decay
+
+  bool GetKey(double x, double y, unsigned &key) const;
+  void Compact(void);
+};
+
+#endif // __PIXEL_CORRELATOR_H_
@@ -0,0 +1,108 @@
+/** \file PixieHeader.h
+ *  \brief Channel header layouts of the Pixie16 firmware revisions
+ *
+ *  Each layout gives the position of every header field as compile-time
+ *  constants. The decoder is a template specialized on the layout, so the
+ *  fields are extracted with fixed shifts and masks, and the layout of each
+ *  module is picked at run time for crates mixing firmware revisions.
+ */
+
+#ifndef __PIXIE_HEADER_H_
+#define __PIXIE_HEADER_H_
+
+#include <string>
+#include <vector>
+
+#include "param.h"
+
+class ChanEvent;
+
+namespace pixie {
+    /** A field of Bits bits starting at bit Shift of the header word Word */
+    template<unsigned Word, unsigned Shift, unsigned Bits>
+    struct HeaderField {
+	static const word_t mask = (~word_t(0)) >> (32 - Bits);
+	static word_t Get(const word_t *header) {
+	    return (header[Word] >> Shift) & mask;
+	}
+    };
+
+    /** Fields common to all revisions */
+    struct HeaderCommon {
+	typedef HeaderField<0,  0,  4> Chan;
+	typedef HeaderField<0,  4,  4> Slot;
+	typedef HeaderField<0,  8,  4> Crate;
+	typedef HeaderField<0, 12,  5> HeaderLength;
+	typedef HeaderField<1,  0, 32> TimeLow;
+	typedef HeaderField<2,  0, 16> TimeHigh;
+	typedef HeaderField<3, 16, 16> TraceLength;
+	/// header words read for every channel
+	static const unsigned minHeaderLength = 4;
+    };
+
+    /** Revisions A to C: 14 bit CFD time taken as the trigger time,
+     *  saturation with the energy, no pileup flag of its own */
+    struct RevALayout : public HeaderCommon {
+	typedef HeaderField<0, 17, 14> EventLength;
+	typedef HeaderField<0, 31,  1> Pileup;
+	typedef HeaderField<3, 15,  1> Saturated;
+	typedef HeaderField<2, 16, 14> Cfd;
+	typedef HeaderField<2, 31,  1> CfdForced;
+	typedef HeaderField<3,  0, 15> Energy;
+	/// trigger time is the CFD time instead of the low event time
+	static const bool cfdTrigTime = true;
+	static bool ValidHeader(word_t length) {return length == 4;}
+    };
+
+    /** Revision D (100 MHz): 15 bit CFD fraction, saturation next to the
+     *  pileup (finish code) bit */
+    struct RevDLayout : public HeaderCommon {
+	typedef HeaderField<0, 17, 13> EventLength;
+	typedef HeaderField<0, 30,  1> Saturated;
+	typedef HeaderField<0, 31,  1> Pileup;
+	typedef HeaderField<2, 16, 15> Cfd;
+	typedef HeaderField<2, 31,  1> CfdForced;
+	typedef HeaderField<3,  0, 16> Energy;
+	static const bool cfdTrigTime = false;
+	static bool ValidHeader(word_t length) {return length == 4;}
+    };
+
+    /** Revision F (2012 and later firmware): virtual channel bit shortens
+     *  the event length, optional energy sums and QDCs follow the first four
+     *  header words */
+    struct RevFLayout : public HeaderCommon {
+	typedef HeaderField<0, 17, 12> EventLength;
+	typedef HeaderField<0, 30,  1> Saturated;
+	typedef HeaderField<0, 31,  1> Pileup;
+	typedef HeaderField<2, 16, 15> Cfd;
+	typedef HeaderField<2, 31,  1> CfdForced;
+	typedef HeaderField<3,  0, 16> Energy;
+	static const bool cfdTrigTime = false;
+	static bool ValidHeader(word_t length) {
+	    return length == 4 || length == 8 || length == 12 || length == 16;
+	}
+    };
+
+    /// firmware revisions known to the decoder
+    enum EFirmware {FIRMWARE_REVA, FIRMWARE_REVD, FIRMWARE_REVF};
+}
+
+namespace readbuff {
+    void SetFirmware(unsigned modNum, pixie::EFirmware firmware);
+    void SetDefaultFirmware(pixie::EFirmware firmware);
+    pixie::EFirmware GetDefaultFirmware(void);
+    pixie::EFirmware GetFirmware(unsigned modNum);
+    bool SetFirmwares(const std::string &spec);
+    bool ParseFirmware(const std::string &name, pixie::EFirmware &firmware);
+    const char* GetFirmwareName(pixie::EFirmware firmware);
+    void SetResync(bool resync);
+    bool GetResync(void);
+
+    int IndexBuffData(pixie::word_t *buf, unsigned long *bufLen,
+		      pixie::word_t &modNum,
+		      std::vector<const pixie::word_t*> &hits);
+    void DecodeHits(const pixie::word_t *const *hits, size_t numHits,
+		    pixie::word_t modNum, ChanEvent **events);
+}
+
+#endif // __PIXIE_HEADER_H_
@@ -0,0 +1,90 @@
+/** \file Profiler.h
+ *  \brief Latency histograms of the processing stages
+ *
+ *  Each stage of the analysis (decoding, sorting, event building,
+ *  calibration, processing, plotting, the whole spill and every event
+ *  processor) records the
+ *  time spent per call, measured with clock_gettime(), into a log-binned
+ *  histogram from which the call count, mean, percentiles and maximum are
+ *  reported. The plot calls are too frequent and short to time them all,
+ *  only one out of plotSampling is timed and the call count and total time
+ *  of the stage are scaled back up to estimate those of all the calls.
+ */
+
+#ifndef __PROFILER_H_
+#define __PROFILER_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * \brief Per-stage call counts and latency distributions
+ */
+class Profiler {
+ public:
+    /// stages known to the scan, processors register further ones
+    enum EStage {DECODE, SORT, BUILD, CALIBRATE, PROCESS, PLOT, TRACE,
+		 TIMING, SPILL, NUM_STAGES};
+
+    /// latencies are binned with 4 bins per power of two nanoseconds, up to 2^61 ns
+    static const unsigned numBins = 240;
+    /// plot calls are timed one out of this many
+    static const unsigned plotSampling = 64;
+
+    /// times a stage from construction until Stop() or destruction
+    class Scope {
+    public:
+	Scope(unsigned stage) : stage(stage), begin(Now()), running(true) {}
+	~Scope() {Stop();}
+	uint64_t Stop(void);
+    private:
+	unsigned stage;
+	uint64_t begin;
+	bool running;
+    };
+
+    Profiler();
+
+    unsigned Register(const std::string &name);
+    void Add(unsigned stage, uint64_t ns);
+    void Report(std::ostream &out = std::cout) const;
+    void Reset(void);
+
+    uint64_t GetCount(unsigned stage) const
+	{return stages.at(stage).count * stages.at(stage).sampling;}
+    double GetTotal(unsigned stage) const
+	{return stages.at(stage).total * stages.at(stage).sampling * 1e-9;}
+    const std::string& GetName(unsigned stage) const {return stages.at(stage).name;}
+    double GetPercentile(unsigned stage, double fraction) const
+	{return stages.at(stage).Percentile(fraction) * 1e-9;}
+    unsigned GetNumStages(void) const {return stages.size();}
+
+    /** monotonic time in nanoseconds */
+    static uint64_t Now(void);
+
+ private:
+    /// distribution of the latencies of one stage
+    struct Stage {
+	std::string name;
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	unsigned sampling; ///< calls per call timed
+	std::vector<uint64_t> bins;
+
+	Stage(const std::string &n);
+	double Percentile(double fraction) const;
+    };
+
+    std::vector<Stage> stages;
+
+    static unsigned Bin(uint64_t ns);
+    static uint64_t BinLow(unsigned bin);
+};
+
+extern Profiler profiler; ///< profiler of the whole scan, in PixieStd.cpp
+
+#endif // __PROFILER_H_
@@ -11,6 +11,7 @@
 
 #include "EventProcessor.h"
 #include "RawEvent.h"
+#include "PixelCorrelator.h"
 
 class DetectorSummary;
 class RawEvent;
@@ -112,6 +113,8 @@ private:
 
     //processor_struct::PSPMT PSstruct; //!< PSPMT root Struct
 
+    PixelCorrelator pixels; //!< implant-decay correlations of the YSO positions
+
     std::string VDtypeStr; //!< VD Type as a string
     std::string ThreshStr; //!< Threshold as a string
 
@@ -18,6 +18,7 @@
 
 #include "pixie16app_defs.h"
 #include "param.h"
+#include "TraceView.h"
 
 using std::map;
 using std::set;
@@ -67,6 +68,23 @@ class Identifier {
     } /**< Compare this identifier with another */
 };
 
+/**
+ * \brief Features of a trace computed in a single pass by the TraceAnalyzer
+ *
+ * The waveform window around the maximum runs from maxPos - windowLow
+ * to maxPos + windowHigh (see TraceAnalyzer), unset values are -1.
+ */
+struct TraceFeatures {
+    double baseline;        /**< Average of the first samples */
+    double stdDevBaseline;  /**< Standard deviation of the first samples */
+    double maxValue;        /**< Maximum value, baseline not subtracted */
+    int maxPos;             /**< Position of the maximum */
+    double qdc;             /**< Baseline subtracted integral of the waveform window */
+    unsigned int saturated; /**< Number of saturated samples */
+
+    void Zero();
+};
+
 /**
  * \brief A channel event
  * 
@@ -76,6 +94,11 @@ class Identifier {
  * identifier, calibrated energies, trace analysis information.
 */
 class ChanEvent {
+ public:
+    /** Pileup of a channel, resolved when the trace gives both pulses,
+     *  see TraceAnalyzer::INFO_ENERGY1 and following for their values */
+    enum EPileup {NO_PILEUP, PILEUP_UNRESOLVED, PILEUP_RESOLVED};
+
  private:
     double energy;             /**< Raw channel energy */
     double calEnergy;          /**< Calibrated channel energy,
@@ -83,7 +106,9 @@ class ChanEvent {
 				  function in the detector_driver.cpp */
     double calTime;            /**< Calibrated time, currently unused */
     vector<double> traceInfo;  /**< Values from trace analysis functions */
-    vector<int> trace;         /**< Channel trace if present */
+    unsigned int traceDone;    /**< Trace analysis products already done */
+    TraceFeatures features;    /**< Trace features, valid once done */
+    TraceView trace;           /**< Channel trace if present, in the spill buffer */
     unsigned long trigTime;    /**< The channel trigger time, trigger time and the lower 32 bits
 				     of the event time are not necessarily the same but could be
 				     separated by a constant value.*/
@@ -92,15 +117,22 @@ class ChanEvent {
     unsigned long runTime0;    /**< Lower bits of run time */
     unsigned long runTime1;    /**< Upper bits of run time */
     unsigned long runTime2;    /**< Higher bits of run time */
+    unsigned long cfdTime;     /**< On-board CFD fraction of a clock tick, 0 if none */
+    bool cfdValidBit;          /**< On-board CFD fraction is valid, not forced */
+    bool pileupBit;            /**< Pileup flagged by the module */
+    bool saturatedBit;         /**< Out of range energy flagged by the module */
 
     double time;               /**< Raw channel time, 64 bit from pixie16 channel event time */
+    double highResTime;        /**< High resolution time in clock ticks, set by the TimingEngine */
     int    modNum;             /**< Module number */
     int    chanNum;            /**< Channel number */
 
+    EPileup pileup;            /**< Pileup classification */
+
     void ZeroNums(void);       /**< Zero members which do not have constructors associated with them */
     
     // make the front end responsible for reading the data able to set the channel data directly
-    friend int ReadBuffData(unsigned int *, unsigned long *, vector<ChanEvent *> &);
+    template<class Layout> friend class BufferDecoder;
  public:
     static const double pixieEnergyContraction; ///< energies from pixie16 are contracted by this number
 
@@ -110,13 +142,18 @@ class ChanEvent {
     void SetCalEnergy(double a) {calEnergy = a;} /**< Set the calibrated energy */
     void SetTime(double a)      {time = a;}      /**< Set the raw time */
     void SetCalTime(double a)   {calTime = a;}   /**< Set the calibrated time */
+    void SetHighResTime(double a) {highResTime = a;} /**< Set the high resolution time */
+    void SetPileup(EPileup a)   {pileup = a;}    /**< Set the pileup classification */
     void AddTraceInfo(double a) {traceInfo.push_back(a);} /**< Add one value to the traceinfo */
+    void SetTraceInfo(unsigned int a, double b); /**< Set a specific value of the traceinfo */
+    void AddTraceDone(unsigned int a) {traceDone |= a;} /**< Mark trace analysis products as done */
 
     double GetEnergy() const      {return energy;}      /**< Get the raw energy */
     double GetCalEnergy() const   {return calEnergy;}   /**< Get the calibrated energy */
     double GetTime() const        {return time;}        /**< Get the raw time */
     double GetCalTime() const     {return calTime;}    /**< Get the calibrated time */
-    const vector<int> &GetTraceRef() const {return trace;} /**< Get a reference to the trace */
+    double GetHighResTime() const {return highResTime;} /**< Get the high resolution time */
+    const TraceView &GetTraceRef() const {return trace;} /**< Get a reference to the trace */
 
     unsigned long GetTrigTime() const    
 	{return trigTime;}    /**< Return the channel trigger time */
@@ -130,11 +167,27 @@ class ChanEvent {
 	{return runTime1;}    /**< Return the middle bits of run time */
     unsigned long GetRunTime2() const
 	{return runTime2;}    /**< Return the higher bits of run time */
+    unsigned long GetCfdTime() const
+	{return cfdTime;}     /**< Return the on-board CFD fraction */
+    bool GetCfdValid() const
+	{return cfdValidBit;} /**< Return whether the on-board CFD fraction is valid */
+    bool GetPileupBit() const
+	{return pileupBit;}   /**< Return whether the module flagged pileup */
+    bool GetSaturatedBit() const
+	{return saturatedBit;} /**< Return whether the module flagged saturation */
+    EPileup GetPileup() const
+	{return pileup;}      /**< Return the pileup classification */
 
     const Identifier& GetChanID() const; /**< Get the channel identifier */
     int GetID() const;                   /**< Get the channel id defined as
 					    pixie module # * 16 + channel number */
     double GetTraceInfo(unsigned int a) const; /**< Get a specific value from the traceinfo */
+    unsigned int GetTraceDone() const
+	{return traceDone;}  /**< Return the trace analysis products already done */
+    const TraceFeatures& GetTraceFeatures() const
+	{return features;}   /**< Return the features of the trace */
+    TraceFeatures& GetTraceFeatures()
+	{return features;}   /**< Return the features of the trace to fill */
 
 /****Added for SVP ****/
     double TrcQDC, MaxValue;
@@ -231,22 +284,4 @@ class RawEvent {
 	{return eventList;} /**< Get the list of events */
 };
 
-class StatsData {
- private:
-  static const size_t statSize = N_DSP_PAR - DSP_IO_BORDER;
-  static const size_t maxVsn = 14;
-
-  pixie::word_t oldData[maxVsn][statSize]; /**< Older statistics data to calculate the change in statistics */
-  pixie::word_t data[maxVsn][statSize];    /**< Statistics data from each module */
- public:
-  static const pixie::word_t headerLength = 1;
-
-  StatsData(void);
-  void DoStatisticsBlock(pixie::word_t *buf, int vsn);
-
-  double GetCurrTime(unsigned int id) const;
-  double GetDiffPeaks(unsigned int id) const;
-  double GetDiffTime(unsigned int id) const;
-};
-
 #endif // __RAWEVENT_H_
@@ -0,0 +1,67 @@
+/** \file SpillDecoder.h
+ *  \brief Decoding of the module buffers of a spill on worker threads
+ *
+ *  The buffers of a spill are indexed one after another as they are found
+ *  in the spill, statistics blocks and errors being handled there. Once the
+ *  spill is complete the indexed channels of all modules are decoded at
+ *  once, one module at a time per thread, each writing its channels
+ *  directly to their final place in the event list.
+ */
+
+#ifndef __SPILL_DECODER_H_
+#define __SPILL_DECODER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "param.h"
+
+class ChanEvent;
+
+/**
+ * \brief Two-pass decoder of the buffers of a spill
+ */
+class SpillDecoder {
+ public:
+    SpillDecoder();
+    ~SpillDecoder();
+
+    void SetThreads(unsigned n);
+    unsigned GetThreads(void) const {return workers.size() + 1;}
+
+    int Add(pixie::word_t *buf, unsigned long *bufLen);
+    void Decode(std::vector<ChanEvent*> &eventList);
+    void Clear(void);
+
+    size_t GetNumHits(void) const {return hits.size();}
+
+ private:
+    /// indexed channels of one module buffer
+    struct Module {
+	pixie::word_t modNum;
+	size_t first;   ///< first hit of the module in hits
+	size_t size;    ///< number of hits
+    };
+
+    std::vector<const pixie::word_t*> hits; ///< start of each indexed channel
+    std::vector<Module> modules;            ///< module buffers of the spill
+    ChanEvent **output;                     ///< where the spill is decoded to
+
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable wake;    ///< a spill is ready or the pool stops
+    std::condition_variable finished;///< all workers are done with the spill
+    unsigned generation;             ///< number of spills handed to the pool
+    unsigned running;                ///< workers still decoding the spill
+    bool stop;
+    std::atomic<size_t> nextModule;  ///< next module to be decoded
+
+    void Work(void);
+    void DecodeModules(void);
+    void StopWorkers(void);
+};
+
+#endif // __SPILL_DECODER_H_
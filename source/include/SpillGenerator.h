@@ -0,0 +1,71 @@
+/** \file SpillGenerator.h
+ *  \brief Synthetic Pixie16 Rev. D spills for benchmarking
+ *
+ *  Spills are laid out the way hissub_sec() receives them from the poll
+ *  program: one record per module in readout order, each holding the Rev. D
+ *  channel headers (and traces) of the module in time order, followed by the
+ *  end of spill record.
+ */
+
+#ifndef __SPILL_GENERATOR_H_
+#define __SPILL_GENERATOR_H_
+
+#include <vector>
+
+#include "MersenneTwister.h"
+#include "param.h"
+#include "StatsData.h"
+
+/**
+ * \brief Generator of spills of random events
+ */
+class SpillGenerator {
+ public:
+    /// what the spills are made of
+    struct Config {
+	unsigned numModules;    ///< modules read out in each spill
+	std::vector<unsigned> channels; ///< ids (16 * module + channel) which fire
+	double rate;            ///< events per second
+	double spillLength;     ///< length of a spill in seconds
+	unsigned multiplicity;  ///< channels per event
+	unsigned traceLength;   ///< samples per channel, 0 for no traces
+	unsigned statsInterval; ///< a statistics block every so many spills, 0 for none
+	unsigned seed;
+
+	Config();
+    };
+
+    SpillGenerator(const Config &config);
+
+    void Generate(std::vector<pixie::word_t> &spill);
+
+    size_t GetNumHits(void) const {return numHits;}
+    size_t GetNumSpills(void) const {return numSpills;}
+
+ private:
+    /// a channel of an event before it is written to its module
+    struct Hit {
+	double time;     ///< in clock ticks
+	unsigned id;
+	unsigned energy;
+    };
+
+    static const unsigned eventSpread = 20;   ///< time spread of the channels of an event
+    static const unsigned pulsePosition = 4;  ///< pulse at 1/4 of the trace
+    static const unsigned baseline = 100;
+
+    Config config;
+    MTRand random;
+    double clock;      ///< time of the last event in clock ticks
+    size_t numHits;    ///< hits of the last spill
+    size_t numSpills;
+
+    std::vector<Hit> hits;
+    std::vector<std::vector<Hit> > moduleHits;
+    std::vector<StatsData::ModuleStats> moduleStats; ///< counters for the statistics blocks
+
+    void WriteHit(const Hit &hit, std::vector<pixie::word_t> &spill);
+    void WriteStatistics(unsigned mod, std::vector<pixie::word_t> &spill);
+};
+
+#endif // __SPILL_GENERATOR_H_
@@ -0,0 +1,90 @@
+/** \file SpillQueue.h
+ *  \brief Queue of reassembled spills between the acquisition and the
+ *  analysis when running live
+ *
+ *  hissub_() is called by scanor with the chunks read from the acquisition
+ *  shared memory. In live mode the reassembled spills are pushed on this
+ *  queue and analyzed on a thread of their own, so that scanor keeps up with
+ *  the acquisition while the analysis works. When the queue is full the
+ *  policy decides what happens:
+ *   - BLOCK waits for room, holding back scanor and so the acquisition
+ *   - DROP_OLDEST discards the oldest queued spill, counting what is lost
+ *   - DECIMATE blocks as well, but the analysis is told how full the queue
+ *     is so that it sheds its less important work while behind
+ */
+
+#ifndef __SPILL_QUEUE_H_
+#define __SPILL_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "param.h"
+
+/**
+ * \brief Bounded queue of spills with an analysis thread
+ */
+class SpillQueue {
+ public:
+    enum EPolicy {BLOCK, DROP_OLDEST, DECIMATE};
+
+    /// analysis of one spill, backlog is the fill of the queue (0 to 1) when
+    /// load may be shed, 0 otherwise. Returns true if some work was shed.
+    typedef bool (*Consumer)(const pixie::word_t *data, size_t nWords,
+			     double backlog);
+
+    /// what happened to the spills so far
+    struct Stats {
+	uint64_t pushed;        ///< spills received
+	uint64_t processed;     ///< spills analyzed
+	uint64_t decimated;     ///< spills analyzed with some work shed
+	uint64_t dropped;       ///< spills discarded
+	uint64_t droppedWords;  ///< words of the discarded spills
+	uint64_t blockedNs;     ///< time the acquisition side waited for room
+	size_t maxOccupancy;    ///< most spills queued at once
+    };
+
+    SpillQueue();
+    ~SpillQueue();
+
+    bool Start(EPolicy policy, size_t capacity, Consumer consumer);
+    void Stop(void);
+    bool IsRunning(void) const {return running;}
+
+    bool Push(const pixie::word_t *data, size_t nWords);
+
+    size_t GetOccupancy(void) const;
+    size_t GetCapacity(void) const {return capacity;}
+    Stats GetStats(void) const;
+    void Report(std::ostream &out) const;
+
+    static bool ParsePolicy(const std::string &name, EPolicy &policy);
+    static const char* GetPolicyName(EPolicy policy);
+
+ private:
+    EPolicy policy;
+    size_t capacity;
+    Consumer consumer;
+    bool running;   ///< the analysis thread is started
+    bool stop;      ///< the analysis thread should finish the queue and stop
+
+    std::deque<std::vector<pixie::word_t> > queue;
+    std::vector<std::vector<pixie::word_t> > freeSpills; ///< buffers for reuse
+    Stats stats;
+
+    mutable std::mutex queueMutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::thread worker;
+
+    void Work(void);
+};
+
+#endif // __SPILL_QUEUE_H_
@@ -0,0 +1,93 @@
+/** \file StatsData.h
+ *  \brief Run statistics of the modules from the statistics blocks
+ *
+ *  The poll program inserts the DSP output parameters of each module in the
+ *  data stream every few seconds. The real time of the module and the live
+ *  time, fast peaks (input counts) and channel events (output counts) of each
+ *  channel are decoded with the parameter addresses of the module's firmware.
+ *  The change between two blocks gives the input and output count rates and
+ *  the dead time fraction of each channel over that interval, which are
+ *  plotted against the real time of the run.
+ */
+
+#ifndef __STATS_DATA_H_
+#define __STATS_DATA_H_
+
+#include <iostream>
+
+#include "pixie16app_defs.h"
+#include "param.h"
+#include "PixieHeader.h"
+
+namespace pixie {
+    /** Position of the run statistics in the DSP output parameters of a
+     *  firmware, counted from DSP_IO_BORDER. Each counter is split in a high
+     *  (A) and a low (B) 32 bit word, the 16 low words of the channel
+     *  counters follow their 16 high words.
+     */
+    struct StatsLayout {
+	size_t realTime;   ///< RealTimeA, RealTimeB is next
+	size_t liveTime;   ///< LiveTimeA of channel 0
+	size_t fastPeaks;  ///< FastPeaksA of channel 0
+	size_t chanEvents; ///< ChanEventsA of channel 0
+	double realTick;   ///< seconds per count of the real time
+	double liveTick;   ///< seconds per count of the live time
+
+	static const StatsLayout& Get(EFirmware firmware);
+    };
+}
+
+/**
+ * \brief Decoded statistics of each module
+ */
+class StatsData {
+ public:
+    /// counters of a channel since the start of the run
+    struct ChannelStats {
+	double liveTime;      ///< in seconds
+	double fastPeaks;     ///< triggers seen by the fast filter
+	double outputCounts;  ///< events written out
+    };
+    /// counters of a module since the start of the run
+    struct ModuleStats {
+	double realTime;      ///< in seconds
+	ChannelStats channel[NUMBER_OF_CHANNELS];
+    };
+
+    static const pixie::word_t headerLength = 1;
+    static const size_t statSize = N_DSP_PAR - DSP_IO_BORDER;
+    static const size_t maxVsn = 14;
+
+    StatsData(void);
+    void DoStatisticsBlock(const pixie::word_t *buf, int vsn);
+    void DeclarePlots(void) const;
+    void Report(std::ostream &out) const;
+
+    double GetRealTime(unsigned int mod) const;
+    double GetDiffRealTime(unsigned int mod) const;
+
+    double GetCurrTime(unsigned int id) const;
+    double GetDiffTime(unsigned int id) const;
+    double GetDiffPeaks(unsigned int id) const;
+    double GetDiffCounts(unsigned int id) const;
+
+    double GetInputRate(unsigned int id) const;
+    double GetOutputRate(unsigned int id) const;
+    double GetDeadFraction(unsigned int id) const;
+
+    static void Encode(const ModuleStats &module, pixie::EFirmware firmware,
+		       pixie::word_t *buf);
+
+ private:
+    ModuleStats oldData[maxVsn]; ///< previous block to calculate the change
+    ModuleStats data[maxVsn];    ///< latest block of each module
+    unsigned numBlocks[maxVsn];  ///< blocks received from each module
+
+    static void Decode(const pixie::word_t *buf, pixie::EFirmware firmware,
+		       ModuleStats &module);
+    void Plot(unsigned int mod) const;
+};
+
+extern StatsData stats;
+
+#endif // __STATS_DATA_H_
@@ -0,0 +1,62 @@
+/** \file Telemetry.h
+ *  \brief Throughput counters of the scan written for the shift dashboards
+ *
+ *  The counters of the scan (spills, hits decoded, events built, reassembly
+ *  failures, words dropped on corrupt data, histogram fills), the time of
+ *  each stage and processor from the profiler and the state of the live
+ *  queue are written every few seconds to a file in the Prometheus text
+ *  format. The file is replaced at once, so it can be read at any time,
+ *  e.g. by the textfile collector of node_exporter or a script feeding the
+ *  dashboards.
+ */
+
+#ifndef __TELEMETRY_H_
+#define __TELEMETRY_H_
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+#include <stdint.h>
+
+/**
+ * \brief Counters of the scan and their periodic export
+ */
+class Telemetry {
+ public:
+    /// what is counted, from the acquisition or the analysis thread
+    enum ECounter {SPILLS, INCOMPLETE_SPILLS, REJECTED_SPILLS,
+		   MISSING_BUFFERS, READOUT_ERRORS, RESYNCS, DROPPED_WORDS,
+		   HITS, EVENTS, NUM_COUNTERS};
+
+    Telemetry();
+
+    bool Open(const std::string &fileName, double interval);
+    bool IsOpen(void) const {return !fileName.empty();}
+
+    void Count(ECounter counter, uint64_t n = 1) {
+	counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t Get(ECounter counter) const {
+	return counters[counter].load(std::memory_order_relaxed);
+    }
+
+    void Update(void);
+    bool Write(void);
+    void WriteMetrics(std::ostream &out);
+
+ private:
+    std::string fileName;
+    uint64_t interval;    ///< between two writes in ns
+    uint64_t start;       ///< time of Open()
+    uint64_t lastWrite;   ///< time of the last write, for the rates
+    uint64_t lastHits;    ///< counts at the last write
+    uint64_t lastEvents;
+    uint64_t lastPlots;
+
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+};
+
+extern Telemetry telemetry; ///< counters of the whole scan, in PixieStd.cpp
+
+#endif // __TELEMETRY_H_
@@ -0,0 +1,56 @@
+/** \file TimingEngine.h
+ *  \brief High resolution time stamps of the channels
+ *
+ *  The 10 ns time stamp of each channel is refined with the fraction of a
+ *  clock tick given by the on-board CFD of the Pixie16 modules or, for
+ *  channels with a trace and no valid on-board CFD, by a digital CFD run on
+ *  the trace. The trace starts a trace delay before the time stamp, which
+ *  depends on the settings of the modules and is given per detector type in
+ *  PIXIE_TRACE_DELAY, e.g. "mtas:50,sili:40" in samples. Types without one
+ *  keep the time stamp. Events are built and the time differences plotted
+ *  with these high resolution times.
+ */
+
+#ifndef __TIMING_ENGINE_H_
+#define __TIMING_ENGINE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TraceView.h"
+
+class ChanEvent;
+class Identifier;
+
+/**
+ * \brief Combines the on-board and digital CFD into a time stamp per channel
+ */
+class TimingEngine {
+ public:
+    static const double cfdScale;       ///< on-board CFD counts per clock tick
+    static const double cfdFraction;    ///< fraction of the digital CFD
+    static const int cfdDelay = 2;      ///< delay of the digital CFD in samples
+    static const int baselineSamples = 15; ///< samples averaged for the baseline
+    static const int minAmplitude = 10; ///< pulses below this have no CFD time
+
+    TimingEngine();
+
+    void Init(const std::vector<Identifier> &modChan);
+    bool SetTraceDelays(const std::string &delays);
+    void Process(const std::vector<ChanEvent*> &eventList);
+    double Time(const ChanEvent *chan);
+    double TraceCfd(const TraceView &trace);
+
+    unsigned long GetNumberOnboard(void) const {return numOnboard;}
+    unsigned long GetNumberTrace(void) const {return numTrace;}
+
+ private:
+    unsigned long numOnboard; ///< channels timed by the on-board CFD
+    unsigned long numTrace;   ///< channels timed by the digital CFD
+
+    std::vector<std::pair<std::string, double> > typeDelays; ///< from PIXIE_TRACE_DELAY
+    std::vector<double> traceDelayOfId; ///< trace delay of each channel id, -1 if unknown
+};
+
+#endif // __TIMING_ENGINE_H_
@@ -10,25 +10,25 @@
 #include <string>
 #include <vector>
 
-#include <sys/times.h>
+#include "TraceView.h"
 
 using std::string;
 using std::vector;
 
+class ChanEvent;
+struct TraceFeatures;
+
 
 /** \brief quick online trace analysis
  *
  * Trace class implements a quick online trapezoidal fiter for the
  * identification of double pulses with relatively little computation.
+ * Only the products asked for by the processors of a channel are computed,
+ * once per channel.
  */
 
 class TraceAnalyzer {
  private:
-    // things associated with timing
-    double userTime;          ///< user time used by this class
-    double systemTime;        ///< system time used by this class
-    double clocksPerSecond;   ///< frequency of system clock
-
     vector<double> average;   ///< trace average
     vector<int> fastFilter;   ///< fast filter of trace
     vector<int> energyFilter; ///< energy filter of trace
@@ -36,6 +36,9 @@ class TraceAnalyzer {
 			       * threshold check */
 
     vector<int> flt;         ///< vector used in filter function
+    vector<int> sums;        ///< running sums of the trace being analyzed
+    const ChanEvent *current; ///< channel whose trace fills the buffers
+    int secondStart;         ///< fast filter sample after the first pulse
         
     int t1;                  ///< time of E1 pulse
     int t2;                  ///< time of E2 pulse
@@ -57,13 +60,38 @@ class TraceAnalyzer {
     /** default filename containing filter parameters
      */
     static const std::string defaultFilterFile;
+
+    template<class T> void FillSums(const T *, size_t);
+    void FilterFromSums(vector<int> &, int, int, int, int);
+    void ExtractFeatures(const TraceView &, TraceFeatures &) const;
+    void FindPulse(int);
+    void FindSecondPulse(void);
  public:
+    /** products of the analysis which a processor can ask for, PILEUP
+     *  implies FILTERS and PLOTS implies PILEUP. The baseline, maximum and
+     *  QDC come together in the trace features of the channel. */
+    enum ETraceProduct {BASELINE = 1, ///< mean and deviation of the first samples
+			MAXIMUM = 2,  ///< maximum value, position and saturation
+			QDC = 4,      ///< baseline subtracted waveform integral
+			FILTERS = 8,  ///< filters and first pulse E1, T1
+			PILEUP = 16,  ///< second pulse E2, T2
+			PLOTS = 32,   ///< trace and filter spectra
+			FEATURES = BASELINE | MAXIMUM | QDC,
+			ALL_PRODUCTS = 63};
+    /// position of the filter products in the trace info of a channel
+    enum ETraceInfo {INFO_TIME1, INFO_ENERGY1, INFO_TIME2, INFO_ENERGY2};
+
+    static const unsigned baselineSamples = 15; ///< samples of the baseline
+    static const int windowLow = 2;   ///< waveform window before the maximum
+    static const int windowHigh = 12; ///< waveform window after the maximum
+    static const int saturation = 4095; ///< ADC value of a saturated sample
+
     int Init(const std::string &filterFile=defaultFilterFile);
     void DeclarePlots(void) const;
-    int Analyze(const vector<int> &, const string &, const string &);
+    int Analyze(ChanEvent *chan, unsigned products);
     vector<int> Filter(vector<int> &, int , int , int , int );
     void FilterFill(const vector<int> &, vector<int> &, int, int, int, int);
-    void TracePlot(const vector<int> &);
+    void TracePlot(const TraceView &);
 
     int GetTime(void) const {return t1;}
     int GetSecondTime(void) const {return t2;}
@@ -0,0 +1,45 @@
+/** \file TraceCodec.h
+ *  \brief Compact encoding of traces for storage
+ *
+ *  Consecutive samples of a trace differ little, so a trace is stored as
+ *  its first sample followed by the differences between samples. These
+ *  are zigzag encoded to make them positive and bit-packed in blocks of
+ *  blockSize, each with the width of its largest value. A baseline region
+ *  typically packs into 2-4 bits per sample instead of 16.
+ */
+
+#ifndef __TRACE_CODEC_H_
+#define __TRACE_CODEC_H_
+
+#include <vector>
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "TraceView.h"
+
+/**
+ * \brief Delta, zigzag and bit-packing codec for traces
+ *
+ * Encoded layout: the number of samples (LEB128 varint), the first sample
+ * (2 bytes, little endian), then for each block of deltas one byte with
+ * the bit width followed by the packed bits.
+ */
+class TraceCodec {
+ public:
+    static const unsigned blockSize = 16; ///< deltas sharing a bit width
+
+    static void Encode(const TraceView &trace, std::vector<uint8_t> &out);
+    static size_t Decode(const uint8_t *in, size_t size,
+			 std::vector<uint16_t> &samples);
+
+ private:
+    static uint32_t ZigZag(int32_t value) {
+	return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+    }
+    static int32_t UnZigZag(uint32_t value) {
+	return int32_t(value >> 1) ^ -int32_t(value & 1);
+    }
+};
+
+#endif // __TRACE_CODEC_H_
@@ -0,0 +1,56 @@
+/** \file TraceFile.h
+ *  \brief Traces of the analyzed channels saved to disk
+ *
+ *  With PIXIE_TRACE_FILE set to a file name, the trace of each channel
+ *  going through the detector driver is written to that file compressed
+ *  with TraceCodec. Each encoded trace is decoded again before it is
+ *  written and compared to the samples in the spill buffer, a trace which
+ *  doesn't come back identical is counted and written raw instead.
+ */
+
+#ifndef __TRACE_FILE_H_
+#define __TRACE_FILE_H_
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+class ChanEvent;
+
+/**
+ * \brief Writer of the compressed traces
+ *
+ * File layout (little endian): the 8 characters "PXTRACE1", then for each
+ * trace a record of the channel id (uint32), the time in clock ticks
+ * (double), a flag (uint8, 1 if encoded with TraceCodec, 0 if the samples
+ * are stored raw), the size of the data in bytes (uint32) and the data.
+ */
+class TraceFile {
+ public:
+    static const char magic[8]; ///< start of the file
+
+    TraceFile();
+    ~TraceFile();
+
+    bool Open(const std::string &fileName);
+    bool IsOpen(void) const {return file.is_open();}
+    void Write(const ChanEvent *chan);
+    void Close(void);
+    void Report(std::ostream &out) const;
+
+ private:
+    std::string fileName;
+    std::ofstream file;
+    std::vector<uint8_t> encoded;  ///< reused between the traces
+    std::vector<uint16_t> decoded; ///< round trip of the encoded trace
+
+    uint64_t numTraces;  ///< traces written
+    uint64_t numFailed;  ///< traces which didn't survive the round trip
+    uint64_t rawBytes;   ///< size of the samples written
+    uint64_t fileBytes;  ///< size of the data written
+};
+
+#endif // __TRACE_FILE_H_
@@ -0,0 +1,46 @@
+/** \file TraceView.h
+ *  \brief Read-only view of the 16-bit trace samples of a channel
+ *
+ *  The samples are left where the decoder found them, in the spill buffer,
+ *  which stays valid while the events of the spill are processed. Nothing
+ *  is copied or widened to int.
+ */
+
+#ifndef __TRACE_VIEW_H_
+#define __TRACE_VIEW_H_
+
+#include <stdexcept>
+
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * \brief Samples of a trace with the read interface of a vector
+ */
+class TraceView {
+ public:
+    typedef uint16_t value_type;
+    typedef const uint16_t* const_iterator;
+
+    TraceView() : samples(NULL), length(0) {}
+    TraceView(const uint16_t *samples, size_t length) :
+	samples(samples), length(length) {}
+
+    size_t size() const {return length;}
+    bool empty() const {return length == 0;}
+    const_iterator begin() const {return samples;}
+    const_iterator end() const {return samples + length;}
+    uint16_t operator[](size_t i) const {return samples[i];}
+    uint16_t at(size_t i) const {
+	if (i >= length)
+	    throw std::out_of_range("TraceView::at");
+	return samples[i];
+    }
+    void clear() {samples = NULL; length = 0;}
+
+ private:
+    const uint16_t *samples; ///< first sample, in the spill buffer
+    size_t length;           ///< number of samples
+};
+
+#endif // __TRACE_VIEW_H_
@@ -6,7 +6,10 @@
 #ifndef __WAVEFORMPROCESSOR_H_
 #define __WAVEFORMPROCESSOR_H_
 
+#include <vector>
+
 #include "EventProcessor.h"
+#include "TraceView.h"
 
 class WaveformProcessor : public EventProcessor
 {
@@ -15,13 +18,18 @@ class WaveformProcessor : public EventProcessor
     virtual void DeclarePlots(void) const;
     virtual bool Process(RawEvent &event);
 
-    struct FitData {
-	size_t n;
-	double * y;
-	double * sigma;
-    };
-
  private:
     int counter, TrcCtr, counter_1;
+
+    static const int phaseSteps = 8; ///< phase grid points per sample
+    static const int phaseLow = -1;  ///< lowest phase searched, in samples
+    static const int phaseHigh = 4;  ///< highest phase searched, in samples
+
+    std::vector<double> pulseTemplate; ///< pulse shape on the phase grid
+    std::vector<double> fitTrace;      ///< workspace, baseline subtracted waveform
+    std::vector<double> phaseScore;    ///< workspace, fit quality of each phase
+
+    void MakeTemplate(void);
+    double FitPhase(const TraceView &trace, int maxX, double aveBaseline);
 };
 #endif // __WAVEFORMPROCESSOR_H_
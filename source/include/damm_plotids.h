@@ -1,6 +1,8 @@
 #ifndef __DAMM_PLOTIDS_H_
 #define __DAMM_PLOTIDS_H_ 1
 
+#include <stdint.h>
+
 const int GENERIC_CHANNEL = 10;
 
 namespace dammIds {
@@ -208,6 +210,7 @@ namespace dammIds {
     namespace misc {
 // in detector_driver.cpp
 	const int D_HAS_TRACE = 800;
+	const int DD_PILEUP   = 801;
 // in pixie_std.cpp
 	const int D_HIT_SPECTRUM = 1000;
 	const int D_SUBEVENT_GAP = 1001;
@@ -220,6 +223,11 @@ namespace dammIds {
 	const int DD_BUFFER_START_TIME = 1008;
 	const int DD_RUNTIME_MSEC      = 1010;
 	const int D_NUMBER_OF_EVENTS   = 1011;
+	const int DD_SPILL_QUEUE       = 1012;
+// in StatsData.cpp
+	const int DD_INPUT_RATE        = 1013;
+	const int DD_OUTPUT_RATE       = 1014;
+	const int DD_DEAD_TIME         = 1015;
 	namespace offsets {
 	    const int D_RAW_ENERGY  = 100;
 	    const int D_SCALAR      = 300;
@@ -241,6 +249,16 @@ void plot(int dammid, double val1, double val2 = -1, double val3 = -1,
 void incplot(int dammid, double val1, double val2 = -1, double val3 = -1,
 	  const char* name="h");
 
+/*!
+  skip the plots of the 2D histograms while shedding load
+*/
+void ShedMatrices(bool shed);
+
+/*!
+  number of histogram fills so far
+*/
+uint64_t GetPlotCalls(void);
+
 // miscellaneous damm fortran functions
 extern "C" bool bantesti_(const int &, const int &, const int &);
 extern "C" void count1cc_(const int &, const int &, const int &);
@@ -0,0 +1,180 @@
+/** \file ChainCorrelator.cpp
+ *  \brief Correlates events with earlier tagged events in time windows
+ */
+
+#include <algorithm>
+
+#include "ChainCorrelator.h"
+
+using namespace std;
+
+namespace {
+  /// order entries by time for the binary searches
+  bool EarlierThan(const ChainCorrelator::Entry &e, double t)
+  {
+    return e.time < t;
+  }
+  bool LaterThan(double t, const ChainCorrelator::Entry &e)
+  {
+    return t < e.time;
+  }
+}
+
+/*! By default events are correlated within 100 us and the background is
+ *  sampled in a window of the same width starting 10 ms after the tag
+ */
+ChainCorrelator::ChainCorrelator() :
+  window(0., 100e-6), bkgWindow(10e-3, 10e-3 + 100e-6), maxAge(0.)
+{
+  UpdateMaxAge();
+}
+
+void ChainCorrelator::SetWindow(const Window &w)
+{
+  window = w;
+  UpdateMaxAge();
+}
+
+void ChainCorrelator::SetBackgroundWindow(const Window &w)
+{
+  bkgWindow = w;
+  UpdateMaxAge();
+}
+
+/*! Record a tagged event. Events normally arrive in time order and are
+ *  appended; a late one is inserted in place to keep the queue sorted.
+ */
+void ChainCorrelator::Add(unsigned long location, ETag tag,
+			  double time, double energy)
+{
+  Queue &q = lanes[location].queue[tag];
+
+  if (q.empty() || q.back().time <= time)
+    q.push_back(Entry(time, energy));
+  else
+    q.insert(upper_bound(q.begin(), q.end(), time, LaterThan),
+	     Entry(time, energy));
+  expiry.push(Expiry(time, location));
+}
+
+/*! Collect the events of the given tag at the location for which the time
+ *  elapsed until time falls into the correlation (or background) window,
+ *  latest first. Returns the number of events found.
+ */
+unsigned ChainCorrelator::Correlate(unsigned long location, ETag tag,
+				    double time, vector<Entry> &found,
+				    bool background) const
+{
+  found.clear();
+  const Queue *q = GetQueue(location, tag);
+  if (q == NULL)
+    return 0;
+
+  const Window &w = background ? bkgWindow : window;
+  // the tagged event must lie in (time - w.end, time - w.begin)
+  Queue::const_iterator first = upper_bound(q->begin(), q->end(),
+					    time - w.end, LaterThan);
+  Queue::const_iterator last = lower_bound(first, q->end(),
+					   time - w.begin, EarlierThan);
+  for (Queue::const_iterator it = last; it != first; ) {
+    --it;
+    found.push_back(*it);
+  }
+  return found.size();
+}
+
+/*! Number of events of the given tag in the correlation (or background)
+ *  window before time
+ */
+unsigned ChainCorrelator::Count(unsigned long location, ETag tag,
+				double time, bool background) const
+{
+  const Queue *q = GetQueue(location, tag);
+  if (q == NULL)
+    return 0;
+
+  const Window &w = background ? bkgWindow : window;
+  Queue::const_iterator first = upper_bound(q->begin(), q->end(),
+					    time - w.end, LaterThan);
+  Queue::const_iterator last = lower_bound(first, q->end(),
+					   time - w.begin, EarlierThan);
+  return last - first;
+}
+
+/*! The latest event of the given tag at the location earlier than time,
+ *  NULL if none is stored
+ */
+const ChainCorrelator::Entry* ChainCorrelator::Last(unsigned long location,
+						    ETag tag,
+						    double time) const
+{
+  const Queue *q = GetQueue(location, tag);
+  if (q == NULL)
+    return NULL;
+
+  Queue::const_iterator it = lower_bound(q->begin(), q->end(),
+					 time, EarlierThan);
+  if (it == q->begin())
+    return NULL;
+  return &(*(--it));
+}
+
+/*! Drop the events which can no longer be correlated with anything at or
+ *  after time. Only the locations of the expired events are visited. A time
+ *  earlier than the newest stored events (new run, clock reset) leaves them
+ *  untouched.
+ */
+void ChainCorrelator::Expire(double time)
+{
+  double oldest = time - maxAge;
+
+  while (!expiry.empty() && expiry.top().time < oldest) {
+    map<unsigned long, Lane>::iterator it = lanes.find(expiry.top().location);
+    expiry.pop();
+    if (it == lanes.end())
+      continue;
+
+    bool empty = true;
+    for (int tag = 0; tag < NUM_TAGS; tag++) {
+      Queue &q = it->second.queue[tag];
+      while (!q.empty() && q.front().time < oldest)
+	q.pop_front();
+      if (!q.empty())
+	empty = false;
+    }
+    if (empty)
+      lanes.erase(it);
+  }
+}
+
+void ChainCorrelator::Clear(void)
+{
+  lanes.clear();
+  expiry = priority_queue<Expiry>();
+}
+
+/*! Total number of stored events */
+unsigned long ChainCorrelator::GetSize(void) const
+{
+  unsigned long size = 0;
+  for (map<unsigned long, Lane>::const_iterator it = lanes.begin();
+       it != lanes.end(); ++it) {
+    for (int tag = 0; tag < NUM_TAGS; tag++)
+      size += it->second.queue[tag].size();
+  }
+  return size;
+}
+
+const ChainCorrelator::Queue* ChainCorrelator::GetQueue(unsigned long location,
+							ETag tag) const
+{
+  map<unsigned long, Lane>::const_iterator it = lanes.find(location);
+  if (it == lanes.end() || it->second.queue[tag].empty())
+    return NULL;
+  return &it->second.queue[tag];
+}
+
+void ChainCorrelator::UpdateMaxAge(void)
+{
+  maxAge = max(window.end, bkgWindow.end);
+}
@@ -0,0 +1,190 @@
+/** \file CycleTimeline.cpp
+ *  \brief Implementation of the tape cycle timeline
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "Logger.h"
+#include "param.h"
+#include "RawEvent.h"
+#include "CycleTimeline.h"
+
+using namespace std;
+
+const double CycleTimeline::logicThreshold = 1;
+const double CycleTimeline::resetTime = 10;
+
+namespace {
+    /// order transitions by time for the binary searches
+    struct LaterThan {
+	template<class T>
+	bool operator()(double t, const T &tr) const {return t < tr.time;}
+    };
+}
+
+/*! Measurement is on until told otherwise, as for the default MTAS flags */
+CycleTimeline::CycleState::CycleState() :
+    cycleNumber(0), measureOnTime(-1.),
+    isTapeMoveOn(false), isMeasureOn(true), isBkgOn(false),
+    isLightPulserOn(false), isIrradOn(false)
+{
+}
+
+CycleTimeline::CycleTimeline()
+{
+}
+
+/*! Build the table of logic signals of each channel id from the subtypes of
+ *  the logi channels in the map
+ */
+void CycleTimeline::Init(const vector<Identifier> &modChan)
+{
+    const char *names[] = {"TRU", "IRU", "IRD", "LPU", "LPD", "TMU", "TMD",
+			   "BGU", "BGD", "MSU", "MSD"};
+    const unsigned nNames = sizeof(names) / sizeof(names[0]);
+
+    signalOfId.assign(modChan.size(), 0);
+    for (size_t id = 0; id < modChan.size(); id++) {
+	if (modChan[id].GetType() != "logi")
+	    continue;
+	for (unsigned i = 0; i < nNames; i++) {
+	    if (modChan[id].GetSubtype() == names[i])
+		signalOfId[id] = 1 << i;
+	}
+    }
+}
+
+/*! Logic signal of the channel id, 0 if it is not a logic channel */
+unsigned CycleTimeline::GetSignal(int id) const
+{
+    if (id < 0 || (size_t)id >= signalOfId.size())
+	return 0;
+    return signalOfId[id];
+}
+
+/*! Add the channel to the timeline if it is a fired logic channel */
+void CycleTimeline::Index(const ChanEvent *chan)
+{
+    unsigned signal = GetSignal(chan->GetID());
+    if (signal == 0 || chan->GetEnergy() <= logicThreshold)
+	return;
+    Add(chan->GetTime() * pixie::clockInSeconds, signal);
+}
+
+/*! Insert a logic transition at the given time (s). Transitions normally
+ *  arrive in time order, only the modules of a spill being read one after
+ *  another; a late one is inserted in place and the states after it are
+ *  recomputed. A time far earlier than the end of the timeline is a new run
+ *  for which the timeline restarts from the last known state.
+ */
+void CycleTimeline::Add(double time, unsigned signal)
+{
+    if (!transitions.empty() && time < transitions.back().time - resetTime) {
+	initial = transitions.back().state;
+	transitions.clear();
+    }
+
+    Transition tr;
+    tr.time = time;
+    tr.signal = signal;
+
+    if (transitions.empty() || transitions.back().time <= time) {
+	tr.state = transitions.empty() ? initial : transitions.back().state;
+	Apply(tr.state, signal, time, true);
+	transitions.push_back(tr);
+    } else {
+	vector<Transition>::iterator it =
+	    upper_bound(transitions.begin(), transitions.end(), time, LaterThan());
+	size_t pos = it - transitions.begin();
+	transitions.insert(it, tr);
+	Rebuild(pos);
+    }
+}
+
+/*! Cycle state at the given time (s), including the transitions at that
+ *  very time
+ */
+const CycleTimeline::CycleState& CycleTimeline::Query(double time) const
+{
+    vector<Transition>::const_iterator it =
+	upper_bound(transitions.begin(), transitions.end(), time, LaterThan());
+    if (it == transitions.begin())
+	return initial;
+    return (--it)->state;
+}
+
+/*! Forget all transitions and restart from the default state */
+void CycleTimeline::Clear(void)
+{
+    transitions.clear();
+    initial = CycleState();
+}
+
+void CycleTimeline::Rebuild(size_t from)
+{
+    for (size_t i = from; i < transitions.size(); i++) {
+	transitions[i].state = (i == 0) ? initial : transitions[i - 1].state;
+	Apply(transitions[i].state, transitions[i].signal,
+	      transitions[i].time, false);
+    }
+}
+
+void CycleTimeline::Apply(CycleState &state, unsigned signal, double time,
+			  bool verbose)
+{
+    switch (signal) {
+    case TRIGGER:
+	state.cycleNumber++;
+	state.measureOnTime = time;
+	break;
+    case TAPE_MOVE_ON:
+	if (verbose && state.isTapeMoveOn)
+	    PIXIE_LOG(ERROR, "CycleTimeline: no end of tape movement",
+		      "No end of tape movement signal in the last tape cycle");
+	state.isTapeMoveOn = true;
+	break;
+    case TAPE_MOVE_OFF:
+	state.isTapeMoveOn = false;
+	break;
+    case MEASURE_ON:
+	if (verbose && state.isMeasureOn)
+	    PIXIE_LOG(ERROR, "CycleTimeline: no end of measurement",
+		      "No end of measurement signal in the last tape cycle");
+	state.isMeasureOn = true;
+	break;
+    case MEASURE_OFF:
+	state.isMeasureOn = false;
+	break;
+    case BKG_ON:
+	if (verbose && state.isBkgOn)
+	    PIXIE_LOG(ERROR, "CycleTimeline: no end of background",
+		      "No end of background signal in the last tape cycle");
+	state.isBkgOn = true;
+	break;
+    case BKG_OFF:
+	state.isBkgOn = false;
+	break;
+    case LIGHT_PULSER_ON:
+	if (verbose && state.isLightPulserOn)
+	    PIXIE_LOG(ERROR, "CycleTimeline: no end of light pulser",
+		      "No end of light pulser signal in the last tape cycle");
+	state.isLightPulserOn = true;
+	break;
+    case LIGHT_PULSER_OFF:
+	state.isLightPulserOn = false;
+	break;
+    case IRRAD_ON:
+	if (verbose && state.isIrradOn)
+	    PIXIE_LOG(ERROR, "CycleTimeline: no end of irradiation",
+		      "No end of irradiation signal in the last tape cycle");
+	state.isIrradOn = true;
+	break;
+    case IRRAD_OFF:
+	state.isIrradOn = false;
+	break;
+    default:
+	break;
+    }
+}
@@ -0,0 +1,315 @@
+/** \file DammBackend.cpp
+ *  \brief In process DAMM histograms and their .drr/.his writer
+ *
+ *  Replaces the HHIRF scanor/orph libraries for the programs built without
+ *  them. The channel arithmetic follows scan/set2cc.f.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <cstring>
+#include <ctime>
+
+#include "DammBackend.h"
+
+using namespace std;
+
+DammBackend damm;
+
+DammBackend::DammBackend()
+{
+    Make();
+}
+
+/*! Start a new directory, forgetting all histograms */
+void DammBackend::Make(void)
+{
+    histograms.assign(maxId, Histogram());
+    for (vector<Histogram>::iterator it = histograms.begin();
+	 it != histograms.end(); it++)
+	it->dim = 0;
+    order.clear();
+    memory.clear();
+}
+
+/*! Declare a histogram, raw, scaled, min and max hold one value per
+ *  dimension. The memory is laid out in End().
+ */
+void DammBackend::Declare(int id, int dim, int halfWords, const int *raw,
+			  const int *scaled, const int *min, const int *max,
+			  const char *title, int titleLength)
+{
+    if (id <= 0 || id >= maxId) {
+	cout << "DAMM id " << id << " out of range, histogram not declared"
+	     << endl;
+	return;
+    }
+    Histogram &his = histograms[id];
+    if (his.dim != 0) {
+	cout << "DAMM id " << id << " declared twice, keeping the first"
+	     << endl;
+	return;
+    }
+
+    his.id = id;
+    his.dim = dim;
+    his.halfWords = (halfWords == 2) ? 2 : 1;
+    for (int i = 0; i < 2; i++) {
+	if (i >= dim) {
+	    his.raw[i] = his.scaled[i] = his.min[i] = his.max[i] = 0;
+	    his.shift[i] = 0;
+	    his.length[i] = 1;
+	    continue;
+	}
+	his.raw[i] = raw[i];
+	his.scaled[i] = scaled[i];
+	his.min[i] = min[i];
+	his.max[i] = max[i];
+	his.shift[i] = 0;
+	while (scaled[i] > 0 && (scaled[i] << (his.shift[i] + 1)) <= raw[i])
+	    his.shift[i]++;
+	his.length[i] = max[i] - min[i] + 1;
+    }
+    his.offset = 0;
+    his.title.assign(title, strnlen(title, titleLength));
+    order.push_back(id);
+}
+
+/*! Lay out the histograms in declaration order, full-word ones on a
+ *  full-word boundary, and clear them
+ */
+void DammBackend::End(void)
+{
+    size_t size = 0;
+    for (vector<int>::const_iterator it = order.begin();
+	 it != order.end(); it++) {
+	Histogram &his = histograms[*it];
+	if (his.halfWords == 2)
+	    size += size % 2;
+	his.offset = size;
+	size += size_t(his.length[0]) * his.length[1] * his.halfWords;
+    }
+    memory.assign(size, 0);
+}
+
+/*! The channel for raw parameters x and y, NULL if the histogram doesn't
+ *  exist or they are out of its range
+ */
+uint16_t* DammBackend::Channel(int id, int x, int y)
+{
+    const DammBackend *self = this;
+    return const_cast<uint16_t*>(self->Channel(id, x, y));
+}
+
+const uint16_t* DammBackend::Channel(int id, int x, int y) const
+{
+    if (id <= 0 || id >= maxId)
+	return NULL;
+    const Histogram &his = histograms[id];
+    if (his.dim == 0 || memory.empty())
+	return NULL;
+
+    // a logical shift as ISHFT, negative values land above the range
+    int cx = int(unsigned(x) >> his.shift[0]);
+    if (cx < his.min[0] || cx > his.max[0])
+	return NULL;
+    size_t chan = cx - his.min[0];
+    if (his.dim == 2) {
+	int cy = int(unsigned(y) >> his.shift[1]);
+	if (cy < his.min[1] || cy > his.max[1])
+	    return NULL;
+	chan += size_t(cy - his.min[1]) * his.length[0];
+    }
+    return &memory[his.offset + chan * his.halfWords];
+}
+
+int64_t DammBackend::GetValue(const Histogram &his, const uint16_t *chan)
+{
+    if (his.halfWords == 2)
+	return uint32_t(chan[0]) | (uint32_t(chan[1]) << 16);
+    return chan[0];
+}
+
+/*! Store value in the channel, truncated to its size as DAMM does */
+void DammBackend::SetValue(const Histogram &his, uint16_t *chan, int64_t value)
+{
+    chan[0] = uint16_t(value);
+    if (his.halfWords == 2)
+	chan[1] = uint16_t(uint32_t(value) >> 16);
+}
+
+/*! Add one count, y is ignored for a 1D histogram */
+void DammBackend::Count(int id, int x, int y)
+{
+    uint16_t *chan = Channel(id, x, y);
+    if (chan != NULL)
+	SetValue(histograms[id], chan, GetValue(histograms[id], chan) + 1);
+}
+
+void DammBackend::Set(int id, int x, int y, int z)
+{
+    uint16_t *chan = Channel(id, x, y);
+    if (chan != NULL)
+	SetValue(histograms[id], chan, z);
+}
+
+void DammBackend::Increment(int id, int x, int y, int z)
+{
+    uint16_t *chan = Channel(id, x, y);
+    if (chan != NULL)
+	SetValue(histograms[id], chan, GetValue(histograms[id], chan) + z);
+}
+
+/*! Content of the channel for raw parameters x and y, 0 outside of the
+ *  histogram
+ */
+int DammBackend::Get(int id, int x, int y) const
+{
+    const uint16_t *chan = Channel(id, x, y);
+    return (chan != NULL) ? int(GetValue(histograms[id], chan)) : 0;
+}
+
+namespace {
+    /// fixed size fields of the .drr records, in host byte order as DAMM
+    class Record {
+    public:
+	Record() : pos(0) {memset(data, 0, sizeof(data));}
+	void Put(const void *p, size_t n) {memcpy(data + pos, p, n); pos += n;}
+	void PutShort(int value) {short s = value; Put(&s, sizeof(s));}
+	void PutInt(int value) {int32_t i = value; Put(&i, sizeof(i));}
+	void PutFloat(float value) {Put(&value, sizeof(value));}
+	/// string padded with blanks to n characters
+	void PutString(const string &s, size_t n) {
+	    memset(data + pos, ' ', n);
+	    memcpy(data + pos, s.data(), std::min(s.size(), n));
+	    pos += n;
+	}
+	bool Write(ostream &out) const {
+	    return out.write(data, sizeof(data)).good();
+	}
+    private:
+	char data[128];
+	size_t pos;
+    };
+}
+
+/*! Write baseName.drr and baseName.his, false if either can't be written
+ *
+ *  The .drr holds a 128 byte header ("HHIRFDIR0001", number of histograms,
+ *  half-words of the .his, creation date and description), one 128 byte
+ *  entry per histogram and the list of the ids. The .his holds the channels
+ *  of all histograms at the offsets of their entries.
+ */
+bool DammBackend::Write(const string &baseName) const
+{
+    ofstream drr((baseName + ".drr").c_str(), ios::binary);
+    ofstream his((baseName + ".his").c_str(), ios::binary);
+    if (!drr.good() || !his.good()) {
+	cout << "Can not open " << baseName << ".drr/.his for writing" << endl;
+	return false;
+    }
+
+    time_t now = time(NULL);
+    struct tm *date = localtime(&now);
+
+    Record header;
+    header.PutString("HHIRFDIR0001", 12);
+    header.PutInt(order.size());
+    header.PutInt(memory.size());
+    header.PutInt(0);
+    header.PutInt(date->tm_year + 1900);
+    header.PutInt(date->tm_mon + 1);
+    header.PutInt(date->tm_mday);
+    header.PutInt(date->tm_hour);
+    header.PutInt(date->tm_min);
+    header.PutString("pixie scan, C++ DAMM back end", 84);
+    bool good = header.Write(drr);
+
+    for (vector<int>::const_iterator it = order.begin();
+	 it != order.end(); it++) {
+	const Histogram &h = histograms[*it];
+	Record entry;
+	entry.PutShort(h.dim);
+	entry.PutShort(h.halfWords);
+	for (int i = 0; i < 4; i++)
+	    entry.PutShort(0);  // parameter numbers, none in a C++ scan
+	for (int i = 0; i < 4; i++)
+	    entry.PutShort(i < 2 ? h.raw[i] : 0);
+	for (int i = 0; i < 4; i++)
+	    entry.PutShort(i < 2 ? h.scaled[i] : 0);
+	for (int i = 0; i < 4; i++)
+	    entry.PutShort(i < 2 ? h.min[i] : 0);
+	for (int i = 0; i < 4; i++)
+	    entry.PutShort(i < 2 ? h.max[i] : 0);
+	entry.PutInt(h.offset);
+	entry.PutString("", 12);
+	entry.PutString("", 12);
+	for (int i = 0; i < 4; i++)
+	    entry.PutFloat(0);
+	entry.PutString(h.title, 40);
+	good &= entry.Write(drr);
+    }
+    for (vector<int>::const_iterator it = order.begin();
+	 it != order.end(); it++) {
+	int32_t id = *it;
+	good &= drr.write(reinterpret_cast<const char*>(&id), sizeof(id)).good();
+    }
+
+    if (!memory.empty())
+	good &= his.write(reinterpret_cast<const char*>(&memory[0]),
+			  memory.size() * sizeof(memory[0])).good();
+    if (!good)
+	cout << "Error writing " << baseName << ".drr/.his" << endl;
+    return good;
+}
+
+// the DAMM entry points called by the analysis
+
+extern "C" void hd1d_(const int &id, const int &halfWords, const int &raw,
+		      const int &scaled, const int &min, const int &max,
+		      const char *title, int titleLength)
+{
+    damm.Declare(id, 1, halfWords, &raw, &scaled, &min, &max,
+		 title, titleLength);
+}
+
+extern "C" void hd2d_(const int &id, const int &halfWords,
+		      const int &rawX, const int &scaledX,
+		      const int &minX, const int &maxX,
+		      const int &rawY, const int &scaledY,
+		      const int &minY, const int &maxY,
+		      const char *title, int titleLength)
+{
+    int raw[2] = {rawX, rawY}, scaled[2] = {scaledX, scaledY};
+    int min[2] = {minX, minY}, max[2] = {maxX, maxY};
+    damm.Declare(id, 2, halfWords, raw, scaled, min, max, title, titleLength);
+}
+
+extern "C" void drrmake_()
+{
+    damm.Make();
+}
+
+extern "C" void endrr_()
+{
+    damm.End();
+}
+
+extern "C" void count1cc_(const int &id, const int &x, const int &y)
+{
+    damm.Count(id, x, y);
+}
+
+extern "C" void set2cc_(const int &id, const int &x, const int &y,
+			const int &z)
+{
+    damm.Set(id, x, y, z);
+}
+
+extern "C" void inc2cc_(const int &id, const int &x, const int &y,
+			const int &z)
+{
+    damm.Increment(id, x, y, z);
+}
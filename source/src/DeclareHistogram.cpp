@@ -5,10 +5,13 @@
  */
 
 #include <string>
+#include <vector>
 
 #include <cstring>
 
 #include "DetectorDriver.h"
+#include "Profiler.h"
+#include "StatsData.h"
 #include "damm_plotids.h"
 
 using namespace std;
@@ -19,6 +22,12 @@ const int S1 = 2, S2 = 4, S3 = 8, S4 = 16, S5 = 32, S6 = 64, S7 = 128,
 
 const int GeChan = 63;
 
+// ids of the 2D histograms, and whether their plots are skipped
+static vector<bool> matrixIds;
+static bool shedMatrices = false;
+// histogram fills, for the telemetry and the sampling of the plot timing
+static uint64_t plotCalls = 0;
+
 /* create a DAMM 1D histogram
  * args are damm id, half-words per channel, param length, hist length,
  * low x-range, high x-range, and title
@@ -58,6 +67,11 @@ void DeclareHistogram2D(int dammId, int xSize, int ySize, const char *title,
 {
     hd2d_(dammId, halfWordsPerChan, xSize, xHistLength, xLow, xHigh,
 	  ySize, yHistLength, yLow, yHigh, title, strlen(title));
+    if (dammId >= 0) {
+	if (matrixIds.size() <= size_t(dammId))
+	    matrixIds.resize(dammId + 1, false);
+	matrixIds[dammId] = true;
+    }
 }
 
 void DeclareHistogram2D(int dammId, int xSize, int ySize, 
@@ -108,8 +122,11 @@ extern "C" void drrsub_(unsigned int& iexist)
     DeclareHistogram2D(DD_BUFFER_START_TIME, SE, S6, "dead time - 0.1%");
     DeclareHistogram2D(DD_RUNTIME_MSEC, SE, S7, "run time - ms");
     DeclareHistogram1D(D_NUMBER_OF_EVENTS, S4, "event counter");
+    DeclareHistogram2D(DD_SPILL_QUEUE, S7, S2, "live spill queue %, y shed level");
+    stats.DeclarePlots();
 
     DeclareHistogram1D(D_HAS_TRACE, S7, "channels with traces");
+    DeclareHistogram2D(DD_PILEUP, S7, S2, "pileup: 1 unresolved, 2 resolved");
     
     endrr_(); // wrap things up
 }
@@ -124,6 +141,20 @@ extern "C" void drrsub_(unsigned int& iexist)
       affecting the code
   - and allows for a smooth transition to the creation of ROOT histograms.
 */
+/*! While shedding load the plots of all 2D histograms are skipped, they
+ *  are the most expensive ones and the 1D totals are what is watched online
+ */
+void ShedMatrices(bool shed)
+{
+	shedMatrices = shed;
+}
+
+/*! Number of plot() and incplot() calls which filled a histogram */
+uint64_t GetPlotCalls(void)
+{
+	return plotCalls;
+}
+
 void plot(int dammID, double val1, double val2, double val3, const char *name)
 {
   /*
@@ -135,6 +166,9 @@ void plot(int dammID, double val1, double val2, double val3, const char *name)
     val3   - weight in a 2d
     name   - name of a root spectrum
   */
+	if (shedMatrices && size_t(dammID) < matrixIds.size() && matrixIds[dammID])
+		return;
+	uint64_t begin = (++plotCalls % Profiler::plotSampling == 0) ? Profiler::Now() : 0;
 	if(val1 > -1)
 	{
 		if (val2 == -1 && val3 == -1)
@@ -146,6 +180,8 @@ void plot(int dammID, double val1, double val2, double val3, const char *name)
 		else 
 			set2cc_(dammID,int(val1),int(val2),int(val3));
 	}
+	if (begin != 0)
+		profiler.Add(Profiler::PLOT, Profiler::Now() - begin);
 }
 
 
@@ -160,6 +196,9 @@ void incplot(int dammID, double val1, double val2, double val3, const char *name
     val3   - weight in a 2d
     name   - name of a root spectrum
   */
+	if (shedMatrices && size_t(dammID) < matrixIds.size() && matrixIds[dammID])
+		return;
+	uint64_t begin = (++plotCalls % Profiler::plotSampling == 0) ? Profiler::Now() : 0;
 	if(val1 > -1)
 	{
 		if (val2 == -1 && val3 == -1)
@@ -171,4 +210,6 @@ void incplot(int dammID, double val1, double val2, double val3, const char *name
 		else 
 			inc2cc_(dammID,int(val1),int(val2),int(val3));
 	}
+	if (begin != 0)
+		profiler.Add(Profiler::PLOT, Profiler::Now() - begin);
 }
@@ -37,10 +37,18 @@
 #include <iostream>
 #include <iomanip>
 #include <iterator>
+#include <sstream>
+
+#include <cstdlib>
 
 #include "DetectorDriver.h"
+#include "Logger.h"
+#include "Profiler.h"
 #include "RandomPool.h"
 #include "RawEvent.h"
+#include "SpillQueue.h"
+#include "StatsData.h"
+#include "Telemetry.h"
  
 #include "damm_plotids.h"
 
@@ -77,7 +85,7 @@ extern RandomPool randoms;
 
   Creates instances of all event processors
 */
-DetectorDriver::DetectorDriver()
+DetectorDriver::DetectorDriver() : shedLevel(0)
 {
 //    vecProcess.push_back(new WaveformProcessor());
 //    vecProcess.push_back(new ScintProcessor());
@@ -158,12 +166,58 @@ int DetectorDriver::Init(void)
 	(*it)->Init(*this);	
     }
 
+    // collect the trace products each detector type needs, the traces of
+    // the other types are not analyzed
+    for (vector<EventProcessor *>::iterator it = vecProcess.begin();
+	 it != vecProcess.end(); it++) {
+	const set<string> &types = (*it)->GetTypes();
+	for (set<string>::const_iterator itType = types.begin();
+	     itType != types.end(); itType++) {
+	    traceProducts[*itType] |= (*it)->GetTraceProducts();
+	}
+    }
+
+    // the trace spectra are filled for the types listed in PIXIE_TRACE_PLOTS
+    // (e.g. "mtas,sili" or "all"), they cost a full trace analysis
+    extern vector<Identifier> modChan;
+    const char *plotsVar = getenv("PIXIE_TRACE_PLOTS");
+    if (plotsVar != NULL && *plotsVar != '\0') {
+	istringstream in(plotsVar);
+	string type;
+	while (getline(in, type, ',')) {
+	    if (type == "all") {
+		for (vector<Identifier>::const_iterator it = modChan.begin();
+		     it != modChan.end(); it++) {
+		    if (it->GetType() != "" && it->GetType() != "ignore")
+			traceProducts[it->GetType()] |= TraceAnalyzer::PLOTS;
+		}
+	    } else if (GetKnownDetectors().count(type) == 0) {
+		cout << "Unknown detector type '" << type
+		     << "' in PIXIE_TRACE_PLOTS, its traces are not plotted"
+		     << endl;
+	    } else {
+		traceProducts[type] |= TraceAnalyzer::PLOTS;
+	    }
+	}
+    }
+
+    // the traces of the analyzed channels are saved compressed to the file
+    // named by PIXIE_TRACE_FILE
+    const char *traceFileName = getenv("PIXIE_TRACE_FILE");
+    if (traceFileName != NULL && *traceFileName != '\0' &&
+	traceFile.Open(traceFileName))
+	cout << "Traces written to " << traceFileName << endl;
+
     /*
       Read in the calibration parameters from the file cal.txt
     */
     //cout << "read in the calibration parameters" << endl;
     ReadCal();
 
+    // index the logic channels for the tape cycle timeline
+    cycles.Init(modChan);
+    timing.Init(modChan);
+
     return 0;
 }
 
@@ -186,8 +240,12 @@ int DetectorDriver::ProcessEvent(const string &mode){
       that fired in this particular event.
     */
     plot(dammIds::misc::D_NUMBER_OF_EVENTS, GENERIC_CHANNEL);
+
+    // the matrices, trace plots included, are shed from the first level
+    ShedMatrices(shedLevel > 0);
     
     const vector<ChanEvent *> &eventList = rawev.GetEventList();
+    Profiler::Scope calibrateScope(Profiler::CALIBRATE);
     for(size_t i=0; i < eventList.size(); i++) {
 	ChanEvent *chan = eventList[i];  
 
@@ -196,18 +254,52 @@ int DetectorDriver::ProcessEvent(const string &mode){
 	PlotCal(chan);
         //cout << chan->GetEnergy() << " from DD" <<  endl;       
     } //end chan by chan event processing
+    calibrateScope.Stop();
 
-    // have each processor in the event processing vector handle the event
+    // have each processor in the event processing vector handle the event,
+    // skipping the ones the shed level leaves out
+    Profiler::Scope processScope(Profiler::PROCESS);
     for (vector<EventProcessor *>::iterator iProc = vecProcess.begin();
 	 iProc != vecProcess.end(); iProc++) {
 	if ( (*iProc)->HasEvent() ) {
-	     (*iProc)->Process(rawev);
+	    unsigned level = (*iProc)->GetShedLevel();
+	    if (level != 0 && shedLevel >= level) {
+		(*iProc)->Skip();
+		continue;
+	    }
+	    (*iProc)->Process(rawev);
 	}
     }
+    processScope.Stop();
+    ShedMatrices(false);
 
     return 0;   
 }
 
+/*!
+  \brief adapt the shed level to the backlog of the live analysis
+
+  fill is the fraction of the spill queue in use. The level goes up as
+  soon as the fill passes 1/2, 3/4 and 9/10, and down one level per spill
+  once it is a quarter below the threshold of the current level, so that
+  it does not flicker around a threshold. Returns the new level.
+*/
+unsigned DetectorDriver::SetBacklog(double fill)
+{
+    const double thresholds[maxShedLevel] = {0.5, 0.75, 0.9};
+    const double hysteresis = 0.25;
+
+    unsigned target = 0;
+    while (target < maxShedLevel && fill >= thresholds[target])
+	target++;
+
+    if (target > shedLevel)
+	shedLevel = target;
+    else if (shedLevel > 0 && fill < thresholds[shedLevel - 1] - hysteresis)
+	shedLevel--;
+    return shedLevel;
+}
+
 const set<string>& DetectorDriver::GetUsedDetectors(void) const
 {
     return rawev.GetUsedDetectors();
@@ -250,26 +342,25 @@ int DetectorDriver::ThreshAndCal(ChanEvent *chan)
 	return 0;
     }
     /*
-      If the channel has a trace get it, analyze it and set the energy.
+      If the channel has a trace, analyze it for the products the
+      processors of its type asked for.
     */
     if ( !chan->GetTraceRef().empty() ) {
         plot(dammIds::misc::D_HAS_TRACE,id);
-	vector<double> values;
-
-        traceSub.Analyze(chan->GetTraceRef(), type, subtype);
-     		//energy = traceSub.GetEnergy();
-        //chan->SetEnergy(energy);
-      energy = chan->GetEnergy() + randoms.Get();
-     // energy /= ChanEvent::pixieEnergyContraction;
 
-    } else {
-      // otherwise, use the Pixie on-board calculated energy
-      // add a random number to convert an integer value to a 
-      //   uniformly distributed floating point
-
-      energy = chan->GetEnergy() + randoms.Get();
-      //energy /= ChanEvent::pixieEnergyContraction;
+	map<string, unsigned>::const_iterator itProducts =
+	    traceProducts.find(type);
+	if (itProducts != traceProducts.end() && itProducts->second != 0)
+	    traceSub.Analyze(chan, itProducts->second);
+	traceFile.Write(chan);
     }
+    ClassifyPileup(chan);
+
+    // use the Pixie on-board calculated energy
+    // add a random number to convert an integer value to a 
+    //   uniformly distributed floating point
+    energy = chan->GetEnergy() + randoms.Get();
+    //energy /= ChanEvent::pixieEnergyContraction;
     /*
       Set the calibrated energy for this channel
     */
@@ -283,6 +374,43 @@ int DetectorDriver::ThreshAndCal(ChanEvent *chan)
     return 1;
 }
 
+/*!
+  Analyze the trace of a channel on demand for the given products
+  (TraceAnalyzer::ETraceProduct), products already computed for this channel
+  are not computed again. The results are in the trace info of the channel.
+*/
+int DetectorDriver::AnalyzeTrace(ChanEvent *chan, unsigned products)
+{
+    if (chan->GetTraceRef().empty())
+	return 1;
+    return traceSub.Analyze(chan, products);
+}
+
+/*!
+  Classify the pileup of a channel. A channel is piled up if the module
+  flagged it or if a second pulse was found in its trace. Flagged channels
+  with a trace are searched for the second pulse whatever the processors
+  asked for, the pileup is resolved when both pulses have an energy.
+*/
+void DetectorDriver::ClassifyPileup(ChanEvent *chan)
+{
+    if (chan->GetPileupBit() && !chan->GetTraceRef().empty())
+	traceSub.Analyze(chan, TraceAnalyzer::PILEUP);
+
+    ChanEvent::EPileup pileup = ChanEvent::NO_PILEUP;
+    if ( (chan->GetTraceDone() & TraceAnalyzer::PILEUP) &&
+	 chan->GetTraceInfo(TraceAnalyzer::INFO_ENERGY1) > 0 &&
+	 chan->GetTraceInfo(TraceAnalyzer::INFO_ENERGY2) > 0 ) {
+	pileup = ChanEvent::PILEUP_RESOLVED;
+    } else if (chan->GetPileupBit()) {
+	pileup = ChanEvent::PILEUP_UNRESOLVED;
+    }
+
+    chan->SetPileup(pileup);
+    if (pileup != ChanEvent::NO_PILEUP)
+	plot(dammIds::misc::DD_PILEUP, chan->GetID(), pileup);
+}
+
 /*!
   Plot the raw energies of each channel into the damm spectrum number assigned
   to it in the map file with an offset as defined in damm_plotids.h
@@ -571,6 +699,24 @@ double Calibration::Calibrate(double raw)
 */
 extern "C" void detectorend_()
 {
+    // analyze the spills still queued in live mode
+    extern SpillQueue spillQueue;
+    extern DetectorDriver driver;
+    if (spillQueue.IsRunning()) {
+	spillQueue.Stop();
+	spillQueue.Report(cout);
+    }
+    logger.Report(cout);
+    if (telemetry.Get(Telemetry::RESYNCS) > 0)
+	cout << "Resynchronized " << telemetry.Get(Telemetry::RESYNCS)
+	     << " times on corrupt data, "
+	     << telemetry.Get(Telemetry::DROPPED_WORDS) << " words dropped"
+	     << endl;
+    stats.Report(cout);
+    profiler.Report(cout);
+    telemetry.Write();
+    driver.traceFile.Close();
+    driver.traceFile.Report(cout);
     //cout << "ending, no rootfile " << endl;       
 }
 
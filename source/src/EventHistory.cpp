@@ -0,0 +1,123 @@
+/** \file EventHistory.cpp
+ *  \brief Implementation of the sliding window of built events
+ */
+
+#include <cstddef>
+
+#include "EventHistory.h"
+
+using namespace std;
+
+/*! Allocate the storage for a ring of the given capacity */
+EventHistory::EventHistory(unsigned capacity) :
+    records(capacity > 0 ? capacity : 1), head(0), size(0),
+    added(0), lastBeta(0)
+{
+}
+
+/*! Append an event at the end of the window, overwriting the oldest one
+ *  when the ring is full. An event earlier than the newest record means the
+ *  time stamps were reset (new run, clock reset), so the window is restarted.
+ */
+void EventHistory::Add(double time, bool isBeta, const vector<double> &energy)
+{
+    if (size > 0 && time < Back().time)
+	Clear();
+
+    unsigned pos;
+    if (size < records.size()) {
+	pos = (head + size) % records.size();
+	size++;
+    } else {
+	pos = head;
+	head = (head + 1) % records.size();
+    }
+
+    EventRecord &rec = records[pos];
+    rec.time = time;
+    rec.isBeta = isBeta;
+    for (unsigned i = 0; i < EventRecord::numEnergies; i++)
+	rec.energy[i] = (i < energy.size()) ? energy[i] : -1;
+
+    added++;
+    if (isBeta)
+	lastBeta = added;
+}
+
+/*! Forget all the stored events */
+void EventHistory::Clear(void)
+{
+    head = 0;
+    size = 0;
+    lastBeta = 0;
+}
+
+/*! Return the i-th record counting from the oldest one */
+const EventRecord& EventHistory::At(unsigned i) const
+{
+    return records[(head + i) % records.size()];
+}
+
+/*! Return the n-th most recent record, 0 being the newest */
+const EventRecord& EventHistory::Back(unsigned n) const
+{
+    return At(size - 1 - n);
+}
+
+/*! Return the most recent beta event still in the window or NULL */
+const EventRecord* EventHistory::LastBeta(void) const
+{
+    if (lastBeta == 0 || added - lastBeta >= size)
+	return NULL;
+    return &Back(added - lastBeta);
+}
+
+/*! Index of the first record with a time not earlier than t, Size() if
+ *  there is none
+ */
+unsigned EventHistory::LowerBound(double t) const
+{
+    unsigned lo = 0, hi = size;
+    while (lo < hi) {
+	unsigned mid = lo + (hi - lo) / 2;
+	if (At(mid).time < t)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/*! Count the selected records with a time in the open interval (t1, t2) */
+unsigned EventHistory::CountInWindow(double t1, double t2, ESelect select) const
+{
+    unsigned count = 0;
+    for (unsigned i = LowerBound(t1); i < size && At(i).time < t2; i++) {
+	const EventRecord &rec = At(i);
+	if (rec.time > t1 && Selected(rec, select))
+	    count++;
+    }
+    return count;
+}
+
+/*! Return the earliest selected record in the open interval (t1, t2) or
+ *  NULL if there is none
+ */
+const EventRecord* EventHistory::FirstInWindow(double t1, double t2, ESelect select) const
+{
+    for (unsigned i = LowerBound(t1); i < size && At(i).time < t2; i++) {
+	const EventRecord &rec = At(i);
+	if (rec.time > t1 && Selected(rec, select))
+	    return &rec;
+    }
+    return NULL;
+}
+
+bool EventHistory::Selected(const EventRecord &rec, ESelect select)
+{
+    if (select == BETA)
+	return rec.isBeta;
+    if (select == NOT_BETA)
+	return !rec.isBeta;
+    return true;
+}
@@ -10,11 +10,9 @@
 #include <string>
 #include <vector>
 
-#include <unistd.h>
-#include <sys/times.h>
-
 #include "DetectorDriver.h"
 #include "EventProcessor.h"
+#include "Profiler.h"
 #include "RawEvent.h"
 
 using namespace std;
@@ -22,10 +20,10 @@ using namespace std;
 extern RawEvent rawev; // to access detector summaries
 
 EventProcessor::EventProcessor() : 
-  userTime(0.), systemTime(0.), name("generic"), initDone(false), 
-  didProcess(false)
+  profileStage(0), processBegin(0), name("generic"), initDone(false), 
+  didProcess(false), priority(PRIORITY_NORMAL), cost(COST_LOW), skipped(0),
+  traceProducts(0)
 {
-    clocksPerSecond = sysconf(_SC_CLK_TCK);
 }
 
 EventProcessor::~EventProcessor() 
@@ -33,8 +31,25 @@ EventProcessor::~EventProcessor()
     if (initDone) {
 	// output the time usage
 	cout << "processor " << name << " : " 
-	     << userTime << " user time, "
-	     << systemTime << " system time" << endl;
+	     << profiler.GetTotal(profileStage) << " s in "
+	     << profiler.GetCount(profileStage) << " events, "
+	     << skipped << " skipped" << endl;
+    }
+}
+
+/** The load shed level of the driver from which this processor is skipped,
+ * 0 if it never is. Expensive low priority processors go first, then the
+ * cheap ones, then the expensive normal ones.
+ */
+unsigned EventProcessor::GetShedLevel(void) const
+{
+    switch (priority) {
+    case PRIORITY_LOW:
+	return (cost == COST_HIGH) ? 1 : 2;
+    case PRIORITY_NORMAL:
+	return (cost == COST_HIGH) ? 3 : 0;
+    default:
+	return 0;
     }
 }
 
@@ -79,6 +94,7 @@ bool EventProcessor::Init(DetectorDriver &driver)
     }
 
     initDone = true;
+    profileStage = profiler.Register("processor " + name);
     cout << "processor " << name << " initialized operating on " 
 	 << intersect.size() << " detector type(s)." << endl;
 
@@ -95,7 +111,7 @@ bool EventProcessor::Process(RawEvent &event)
         return (didProcess = false);
 
     // start the process timer
-    times(&tmsBegin);
+    processBegin = Profiler::Now();
     
     return (didProcess = true);
 }
@@ -103,12 +119,7 @@ bool EventProcessor::Process(RawEvent &event)
 /** Wrap up the processing and update the time spent by this processor */
 void EventProcessor::EndProcess(void)
 {
-    tms tmsEnd;
-
-    times(&tmsEnd);
-
-    userTime += (tmsEnd.tms_utime - tmsBegin.tms_utime) / clocksPerSecond;
-    systemTime += (tmsEnd.tms_stime - tmsBegin.tms_stime) / clocksPerSecond;
+    profiler.Add(profileStage, Profiler::Now() - processBegin);
 }
 
 #ifdef useroot
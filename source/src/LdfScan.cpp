@@ -0,0 +1,105 @@
+/*! \file LdfScan.cpp
+ *
+ * Scan of HRIBF list mode data files without the HHIRF scanor. The data
+ * records of each .ldf file are passed to hissub_() as scanor does, and the
+ * histograms of the C++ DAMM back end are written as a .drr/.his pair at the
+ * end, to be viewed with damm.
+ *
+ * An .ldf file is a sequence of records of 8194 words: a four character
+ * type ("DIR ", "HEAD", "DATA", "EOF ", ...) and a word count followed by
+ * 8192 words of data. Only the DATA records hold spill chunks.
+ *
+ * Usage: pixie_ldf_c_slim [-o histogram file base name] file.ldf ...
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "DammBackend.h"
+#include "param.h"
+
+using namespace std;
+using pixie::word_t;
+
+extern "C" void hissub_(unsigned short *sbuf[], unsigned short *nhw);
+extern "C" void drrsub_(unsigned int &iexist);
+extern "C" void detectorend_();
+
+/** Pass the data records of an .ldf file to hissub_(), false if the file
+ *  can't be read to its end
+ */
+static bool ScanFile(const string &name, unsigned long &dataRecords)
+{
+    const size_t recordWords = 8192;
+
+    ifstream file(name.c_str(), ios::binary);
+    if (!file.good()) {
+	cout << "Can not open " << name << endl;
+	return false;
+    }
+    cout << "Scanning " << name << endl;
+
+    vector<word_t> data(recordWords + 1);
+    char type[4];
+    word_t count;
+    while (file.read(type, sizeof(type)) &&
+	   file.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+	if (!file.read(reinterpret_cast<char*>(&data[0]),
+		       recordWords * sizeof(word_t))) {
+	    cout << "Truncated record at the end of " << name << endl;
+	    return false;
+	}
+	if (memcmp(type, "DATA", sizeof(type)) != 0)
+	    continue;
+	// hissub_ stops at a delimiter, never past the record
+	data[recordWords] = U_DELIMITER;
+	unsigned short nhw = recordWords * sizeof(word_t);
+	hissub_(reinterpret_cast<unsigned short**>(&data[0]), &nhw);
+	dataRecords++;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    string baseName = "pixie";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+	switch (opt) {
+	case 'o': baseName = optarg; break;
+	default:
+	    cout << "Usage: " << argv[0] << " [-o histogram file base name] "
+		 << "file.ldf ..." << endl;
+	    return EXIT_FAILURE;
+	}
+    }
+    if (optind >= argc) {
+	cout << "Usage: " << argv[0] << " [-o histogram file base name] "
+	     << "file.ldf ..." << endl;
+	return EXIT_FAILURE;
+    }
+
+    unsigned int iexist = 0;
+    drrsub_(iexist);
+
+    bool good = true;
+    unsigned long dataRecords = 0;
+    for (int i = optind; i < argc; i++)
+	good &= ScanFile(argv[i], dataRecords);
+    cout << dataRecords << " data records scanned" << endl;
+
+    detectorend_();
+
+    good &= damm.Write(baseName);
+    if (good)
+	cout << damm.GetNumHistograms() << " histograms written to "
+	     << baseName << ".drr/.his" << endl;
+    return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+/** \file Logger.cpp
+ *  \brief Implementation of the rate limited logging
+ */
+
+#include <iomanip>
+
+#include <cstdlib>
+
+#include "Logger.h"
+#include "Profiler.h"
+
+using namespace std;
+
+Logger::Site::Site(ESeverity severity, const char *name) :
+    severity(severity), name(name), count(0), written(0), suppressed(0),
+    lastWrite(0)
+{
+}
+
+/*! The level and the output are taken from PIXIE_LOG_LEVEL and
+ *  PIXIE_LOG_FILE, the thread is started by the first message
+ */
+Logger::Logger() :
+    level(INFO), queueDropped(0), writing(0), stop(false), sink(&cout)
+{
+    const char *levelVar = getenv("PIXIE_LOG_LEVEL");
+    if (levelVar != NULL && *levelVar != '\0' &&
+	!ParseSeverity(levelVar, level))
+	cout << "Unknown PIXIE_LOG_LEVEL '" << levelVar
+	     << "', use debug, info, warning or error" << endl;
+
+    const char *fileVar = getenv("PIXIE_LOG_FILE");
+    if (fileVar != NULL && *fileVar != '\0') {
+	file.open(fileVar);
+	if (file.good())
+	    sink = &file;
+	else
+	    cout << "Can not open the log file " << fileVar << endl;
+    }
+}
+
+Logger::~Logger()
+{
+    Stop();
+}
+
+/*! Count a message of the site and tell if it is to be written, i.e. it
+ *  is severe enough and the site is within its rate limit
+ */
+bool Logger::Allow(Site &site)
+{
+    uint64_t count = site.count.fetch_add(1, memory_order_relaxed) + 1;
+    if (count == 1) {
+	lock_guard<mutex> lock(logMutex);
+	sites.push_back(&site);
+    }
+    if (site.severity < level)
+	return false;
+
+    uint64_t now = Profiler::Now();
+    lock_guard<mutex> lock(logMutex);
+    if (site.written < burst || now - site.lastWrite >= limitInterval) {
+	site.written++;
+	site.lastWrite = now;
+	return true;
+    }
+    site.suppressed++;
+    return false;
+}
+
+/*! Queue a message allowed by Allow() for the logging thread */
+void Logger::Write(Site &site, const string &message)
+{
+    ostringstream line;
+    line << "[" << GetSeverityName(site.severity) << "] " << message;
+
+    {
+	lock_guard<mutex> lock(logMutex);
+	if (site.suppressed > 0) {
+	    line << " (" << site.suppressed << " more suppressed)";
+	    site.suppressed = 0;
+	}
+	if (site.written == burst)
+	    line << " (now at most one per second)";
+	line << '\n';
+
+	if (queue.size() >= maxQueued) {
+	    queueDropped++;
+	    return;
+	}
+	if (!worker.joinable())
+	    Start();
+	queue.push_back(line.str());
+    }
+    notEmpty.notify_one();
+}
+
+/*! Wait until the queued messages are written */
+void Logger::Flush(void)
+{
+    unique_lock<mutex> lock(logMutex);
+    while (worker.joinable() && (!queue.empty() || writing > 0))
+	flushed.wait(lock);
+}
+
+/*! Print how often each site fired, most frequent first within each
+ *  severity, once the messages are written
+ */
+void Logger::Report(ostream &out)
+{
+    Flush();
+
+    lock_guard<mutex> lock(logMutex);
+    if (sites.empty())
+	return;
+
+    out << "log summary:" << setw(10) << "severity" << setw(12) << "count"
+	<< setw(10) << "written" << "  site" << endl;
+    for (int sev = NUM_SEVERITIES - 1; sev >= 0; sev--) {
+	vector<Site*> bySeverity;
+	for (vector<Site*>::const_iterator it = sites.begin();
+	     it != sites.end(); it++)
+	    if ((*it)->severity == sev)
+		bySeverity.push_back(*it);
+	for (size_t i = 0; i < bySeverity.size(); i++)
+	    for (size_t j = i + 1; j < bySeverity.size(); j++)
+		if (bySeverity[j]->GetCount() > bySeverity[i]->GetCount())
+		    swap(bySeverity[i], bySeverity[j]);
+	for (vector<Site*>::const_iterator it = bySeverity.begin();
+	     it != bySeverity.end(); it++)
+	    out << "            " << setw(10) << GetSeverityName((*it)->severity)
+		<< setw(12) << (*it)->GetCount() << setw(10) << (*it)->written
+		<< "  " << (*it)->name << endl;
+    }
+    if (queueDropped > 0)
+	out << "            " << queueDropped
+	    << " messages lost with the log queue full" << endl;
+}
+
+/*! Set severity from its name (debug, info, warning or error), false if it
+ *  is unknown
+ */
+bool Logger::ParseSeverity(const string &name, ESeverity &severity)
+{
+    for (int i = 0; i < NUM_SEVERITIES; i++) {
+	if (name == GetSeverityName(ESeverity(i))) {
+	    severity = ESeverity(i);
+	    return true;
+	}
+    }
+    return false;
+}
+
+const char* Logger::GetSeverityName(ESeverity severity)
+{
+    switch (severity) {
+    case DEBUG:   return "debug";
+    case INFO:    return "info";
+    case WARNING: return "warning";
+    case ERROR:   return "error";
+    default:      break;
+    }
+    return "unknown";
+}
+
+/*! Start the logging thread, called with logMutex held */
+void Logger::Start(void)
+{
+    stop = false;
+    worker = thread(&Logger::Work, this);
+}
+
+/*! Write the messages left and stop the logging thread */
+void Logger::Stop(void)
+{
+    {
+	lock_guard<mutex> lock(logMutex);
+	if (!worker.joinable())
+	    return;
+	stop = true;
+    }
+    notEmpty.notify_one();
+    worker.join();
+}
+
+/*! Write the messages as they come, flushing after each batch */
+void Logger::Work(void)
+{
+    deque<string> batch;
+    unique_lock<mutex> lock(logMutex);
+    while (true) {
+	while (!stop && queue.empty())
+	    notEmpty.wait(lock);
+	if (queue.empty())
+	    break;
+
+	batch.swap(queue);
+	writing = batch.size();
+	lock.unlock();
+
+	for (deque<string>::const_iterator it = batch.begin();
+	     it != batch.end(); it++)
+	    *sink << *it;
+	sink->flush();
+	batch.clear();
+
+	lock.lock();
+	writing = 0;
+	flushed.notify_all();
+    }
+    flushed.notify_all();
+}
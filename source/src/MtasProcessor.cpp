@@ -6,40 +6,26 @@
 #include "param.h"
 #include "MtasProcessor.h"
 #include "DetectorDriver.h"
+#include "Logger.h"
 #include "RawEvent.h"
+#include "TraceAnalyzer.h"
 #include <limits>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <math.h>
 #include <cmath> // Include the cmath header for fabs()
+#include <cstdlib>
  
 using std::cout;
 using std::endl;
 using std::vector;
 using std::string;
-
-const double EPSILON = 1e-12;
-
-int counter = 0;
+using std::map;
+using std::pair;
 
 static double measureOnTime = -1.;
 static double firstTime = 0.;
-double time1stany = 0.0; // Variable to store the any first event time
-double time2ndany = 0.0; // Variable to store the any second event time
-double time1stBetaevent = 0.0; // Variable to store the previous bothbeta event time
-double time2ndBetaevent = 0.0; // Variable to store the previous bothbeta event time
-double time1stBetaonly = 0.0; // Variable to store the previous first beta event time with no other event in 15us after it
-double time2nd_1stBetaOnly = 0.0; // Variable to store the previous second beta event time with no other event in 15us after it
-//double previousTime2nd = 0.0; // Variable to store the previous any event second to beta event time
-double previousTime1stBeta = 0.0; // Variable to store the previous 1st beta event time
-double previousTime2nd_notBeta = 0.0; // Variable to store the not beta event second to beta event time 
-vector<double> previousEventEnergyBnB = {0.0,0.0,0.0,0.0,0.0}; // Variable to store the previous event energy for beta not beta events
-vector<double> previousEventEnergyBB = {0.0,0.0,0.0,0.0,0.0}; // Variable to store the previous event energy for beta beta events 
-vector<double> previousEventEnergyAny = {0.0,0.0,0.0,0.0,0.0}; // Variable to store the previous event energy for any two events
-vector<double> previousEventEnergy1stBetaonly = {0.0,0.0,0.0,0.0,0.0}; // Variable to store the previous event energy with no other event in 15us after it 
-bool nextBetarequired = true; // Variable to store the next beta event required
-bool betaEnergy_recorded_once = true; // Variable to store the next beta event required
 bool MtasProcessor::isTapeMoveOn = false;
 bool MtasProcessor::isMeasureOn = true;
 bool MtasProcessor::isBkgOn = false;
@@ -47,10 +33,13 @@ bool MtasProcessor::isLightPulserOn = false;
 bool MtasProcessor::isIrradOn = false;
 double MtasProcessor::measureOnTime = -1; 
 unsigned MtasProcessor::cycleNumber = 0;
+const unsigned MtasProcessor::minGainHits = 100;
 
-MtasProcessor::MtasProcessor():EventProcessor(), mtasSummary(NULL), siliSummary(NULL), geSummary(NULL), sipmSummary(NULL), logiSummary(NULL), refmodSummary(NULL){ //Goetz added refmodSummary subtype
+MtasProcessor::MtasProcessor():EventProcessor(), mtasSummary(NULL), siliSummary(NULL), geSummary(NULL), sipmSummary(NULL), logiSummary(NULL), refmodSummary(NULL), pileupPolicy(PILEUP_KEEP){ //Goetz added refmodSummary subtype
 	firstTime = -1.;	//IS THIS THE SAME AS THE global static double firstTime ? DOUBLE CHECK CPP RULES
 	name = "mtas";
+	priority = PRIORITY_ESSENTIAL; // its matrices are still shed with the plots
+	cost = COST_HIGH;
 	associatedTypes.insert("mtas");
 	associatedTypes.insert("sili");//silicons
 	associatedTypes.insert("ge");
@@ -59,6 +48,25 @@ MtasProcessor::MtasProcessor():EventProcessor(), mtasSummary(NULL), siliSummary(
 	//associatedTypes.insert("ionc");//ionization chamber
 	// Goetz: added reference module type generic for March 2015 experiment 
 	associatedTypes.insert("refmod"); 
+
+	//delayed window skips the prompt beta of the same event, the background
+	//window has the same width 10 ms later
+	chains.SetWindow(ChainCorrelator::Window(1e-6, 100e-6));
+	chains.SetBackgroundWindow(ChainCorrelator::Window(10e-3 + 1e-6, 10e-3 + 100e-6));
+
+	//PIXIE_PILEUP selects the pileup policy, read here so that the trace
+	//products are known when DetectorDriver::Init merges them
+	const char *pileupVar = getenv("PIXIE_PILEUP");
+	if(pileupVar != NULL && *pileupVar != '\0'){
+		EPileupPolicy policy;
+		if(ParsePileupPolicy(pileupVar, policy)){
+			SetPileupPolicy(policy);
+			cout << "Piled up MTAS hits: " << pileupVar << endl;
+		}else
+			cout << "Unknown PIXIE_PILEUP policy '" << pileupVar
+			     << "', use keep, reject or recover. Piled up MTAS hits are kept."
+			     << endl;
+	}
 }
 
 void MtasProcessor::DeclarePlots(void) const{
@@ -128,6 +136,11 @@ void MtasProcessor::DeclarePlots(void) const{
 	DeclareHistogram1D(MTAS_POSITION_ENERGY+703, SE, "TDiff 1st Beta and 2nd !beta");
 	DeclareHistogram1D(MTAS_POSITION_ENERGY+704, S8, "beta-gamma time (10 ns)");
 	DeclareHistogram1D(MTAS_POSITION_ENERGY+705, S8, "beta-IMO time (10 ns)");
+	DeclareHistogram2D(MTAS_POSITION_ENERGY+740, SA, S7, "MTAS / 10  vs beta-delayed time (1 us)");
+	DeclareHistogram1D(MTAS_POSITION_ENERGY+741, EnergyBins, "Total Mtas, beta-delayed");
+	DeclareHistogram1D(MTAS_POSITION_ENERGY+742, EnergyBins, "Total Mtas, beta-delayed random bkg");
+	DeclareHistogram1D(MTAS_POSITION_ENERGY+743, S7, "beta-delayed time (1 us)");
+	DeclareHistogram1D(MTAS_POSITION_ENERGY+744, S2, "MTAS pileup: 0 kept, 1 rejected, 2 recovered");
 
 	//2d plots with time difference for "TDiff 1st Beta only"
 	// DeclareHistogram2D(MTAS_POSITION_ENERGY+704, SA, SA, "MTAS / 10  vs I, M, O / 10");
@@ -314,6 +327,11 @@ bool MtasProcessor::Process(RawEvent &event)
  	FillRefModMapAndEnergy();
 	FillLogicMap(); //Maps are filled with data
 
+	//sets booleans to let us know where we are in the cycle, at the time of
+	//the last channel so that the logic signals of this event are included
+	//options are isTapeMoveOn, isMeasureOn, isBkgOn, isLightPulserOn, isIrradOn, and cycleNumber
+	SetCycleState(event.GetEventList().back()->GetTime() * pixie::clockInSeconds);
+
 	//Set up time for mtas and cycle logic
 	double cycleTime = -1.0;
 	double actualTime = -1.0;
@@ -327,7 +345,7 @@ bool MtasProcessor::Process(RawEvent &event)
 	if(mtasSummary->GetMult() > 0)//I have at leat one element in mtasList
 	{
 		vector<ChanEvent*>::const_iterator mtasListIt = mtasList.begin();
-		actualTime = (*mtasListIt)->GetTime() * pixie::clockInSeconds;
+		actualTime = (*mtasListIt)->GetHighResTime() * pixie::clockInSeconds;
 		if (firstTime == -1.) //COMPARING EQUALITY FOR FLOATS DOESN'T ALWAYS WORK RIGHT
 			firstTime = actualTime;
 			cycleTime = actualTime - measureOnTime;
@@ -355,9 +373,6 @@ bool MtasProcessor::Process(RawEvent &event)
 	vector<double> endtimes = {370*60,1483*60};
 
 
-	SetCycleState();   //sets booleans to let us know where we are in the cycle
-	//options are isTapeMoveOn, isMeasureOn, isBkgOn, isLightPulserOn, isIrradOn, and cycleNumber
-
         //Spectrum number convention
         //0- all mtas, 1 - Central, 2 - Inner, 3 - Middle, 4 - Outer
         vector <double> totalMtasEnergy (5,-1);
@@ -407,7 +422,8 @@ bool MtasProcessor::Process(RawEvent &event)
 		//F+B
 		int moduleIndex = (location -1)/2;
 		if(moduleIndex > 24){
-			cout<<"Warning: detector "<<(*mtasMapIt).first<<" location > 48"<<endl;
+			PIXIE_LOG(WARNING, "MtasProcessor: detector location > 48",
+				  "Detector " << (*mtasMapIt).first << " location > 48");
 			continue;
 		}
 		
@@ -416,7 +432,8 @@ bool MtasProcessor::Process(RawEvent &event)
 		}else if(sumFrontBackEnergy.at(moduleIndex) < 0){	//second signal from this hexagon module
 			sumFrontBackEnergy.at(moduleIndex) = -1*sumFrontBackEnergy.at(moduleIndex) + signalEnergy/2.;
 		}else{							//sumFrontBackEnergy.at(moduleIndex) > 0 - 3 or more signals in one event
-			cout<<"Warning: detector "<<(*mtasMapIt).first<<" has 3 or more signals"<<endl;
+			PIXIE_LOG(WARNING, "MtasProcessor: 3 or more signals in a module",
+				  "Detector " << (*mtasMapIt).first << " has 3 or more signals");
 		}
 		
 	}
@@ -496,173 +513,103 @@ bool MtasProcessor::Process(RawEvent &event)
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Timediff related plots 
-	//Time difference between two beta events
-	//if(isMeasureOn && isBetaSignal && !isBkgOn && !isLightPulserOn && !isTapeMoveOn){
-	if(isMeasureOn && !isBkgOn && isBetaSignal && !isLightPulserOn && !isTapeMoveOn && fabs(actualTime + 1.0) > EPSILON){
-		//fabs is used to avoid floating point comparison problems
-		if (fabs(time1stBetaevent) > EPSILON && fabs(time2ndBetaevent) < EPSILON) {
-			time2ndBetaevent = actualTime; //Update time2ndBetaevent with the current actualTime
-			//std::cout<<"time2ndBetaevent: "<<time2ndBetaevent<<std::endl;
-		}else if (fabs(time1stBetaevent) < EPSILON && fabs(time2ndBetaevent) < EPSILON){
-			time1stBetaevent = actualTime; //Update time1stBetaevent with the current actualTime
-			//std::cout<<"time1stBetaevent: "<<time1stBetaevent<<std::endl;
-			for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyBB.at(j) = totalMtasEnergy.at(j); //Save the current totalMtasEnergy for 1st event in previousEventEnergyBB
-			}
-		}
-		if(fabs(time1stBetaevent) > EPSILON && fabs(time2ndBetaevent) > EPSILON ){
-			double timeDiffBB = fabs((time2ndBetaevent - time1stBetaevent)*100000000.0);//calculate time difference in ns
+	//All inter-event correlations run off the history of the previous
+	//measurement events; the current event is added at the end.
+	//Time differences are plotted in units of 10 ns.
+	if(isMeasureOn && !isBkgOn && !isLightPulserOn && !isTapeMoveOn && actualTime >= 0){
+		const double tenNs = 1.0e+8;
+		const EventRecord *lastBeta = history.LastBeta();
+
+		//Time difference between two beta events
+		if(isBetaSignal && lastBeta != NULL){
+			double timeDiffBB = (actualTime - lastBeta->time) * tenNs;
 			plot(MTAS_POSITION_ENERGY+700, timeDiffBB);//plot time difference between two beta events
 			plot(MTAS_POSITION_ENERGY+368,totalMtasEnergy.at(0) / 10.0, timeDiffBB);
-			if (timeDiffBB > 300.0 + EPSILON && timeDiffBB < 750.0 - EPSILON)
-			{
-				for(int j=0; j<totalMtasEnergy.size(); j++){
-				plot(MTAS_POSITION_ENERGY+280+j, previousEventEnergyBB.at(j));//1st beta event hist
+			if (timeDiffBB > 300.0 && timeDiffBB < 750.0){
+				for(unsigned j=0; j<EventRecord::numEnergies; j++){
+					plot(MTAS_POSITION_ENERGY+280+j, lastBeta->energy[j]);//1st beta event hist
+					plot(MTAS_POSITION_ENERGY+285+j, totalMtasEnergy.at(j));//2nd beta event hist
 				}
-				//2d plot
-				plot(MTAS_POSITION_ENERGY+735, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);//plot total vs C energy of the first beta event
-				for(int i=6; i<24; i++){					
-					plot(MTAS_POSITION_ENERGY+734, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);//plot total vs IMO energy of the first beta event
-				}	
-				for(int k=0; k<totalMtasEnergy.size(); k++){
-					plot(MTAS_POSITION_ENERGY+285+k, totalMtasEnergy.at(k));//2nd beta event hist
+				//2d plots
+				plot(MTAS_POSITION_ENERGY+735, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);
+				plot(MTAS_POSITION_ENERGY+737, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);
+				for(int i=6; i<24; i++){
+					plot(MTAS_POSITION_ENERGY+734, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);
+					plot(MTAS_POSITION_ENERGY+736, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);
 				}
-				//2d plot
-				plot(MTAS_POSITION_ENERGY+737, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);//plot total vs C energy of the second beta event
-				for(int i=6; i<24; i++){					
-					plot(MTAS_POSITION_ENERGY+736, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);//plot total vs IMO energy of the second beta event
-				}		
-			}
-			time1stBetaevent = time2ndBetaevent; //update time1stBetaevent with the current time2ndBetaevent
-			for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyBB.at(j) = totalMtasEnergy.at(j); //Update previousEventEnergyBB with the current totalMtasEnergy
 			}
-			time2ndBetaevent = actualTime;//update time2ndBetaevent with the current actualTime
 		}
- 
-	}
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//Time difference between two events with first beta and second not beta
-	//bool is1stBetaevent = false;
-	// bool is2ndNotBetaevent = false;
-	if(isMeasureOn && !isBkgOn && !isLightPulserOn && !isTapeMoveOn && fabs(actualTime + 1.0) > EPSILON){
-		if(isBetaSignal){
-			previousTime1stBeta = actualTime; //Update previousTime with the current actualTime for a beta event 
-			for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyBnB.at(j) = totalMtasEnergy.at(j);
-			}
-			betaEnergy_recorded_once=false;
-		}
-		if (!isBetaSignal && fabs(previousTime1stBeta) > EPSILON){
-			previousTime2nd_notBeta = actualTime;// Update previousTime with the current actualTime previousTimeBetaBoth
-			double timeDiffBnotB = fabs((previousTime2nd_notBeta - previousTime1stBeta)*1.0e+8);
+		//Time difference between the last beta and the following not beta events
+		if(!isBetaSignal && lastBeta != NULL){
+			double timeDiffBnotB = (actualTime - lastBeta->time) * tenNs;
 			plot(MTAS_POSITION_ENERGY+703, timeDiffBnotB);
 			plot(MTAS_POSITION_ENERGY+367,totalMtasEnergy.at(0) / 10.0, timeDiffBnotB);
 			plot(MTAS_POSITION_ENERGY+370,totalMtasEnergy.at(1) / 10.0, timeDiffBnotB);
 			plot(MTAS_POSITION_ENERGY+372,(totalMtasEnergy.at(2)+totalMtasEnergy.at(3)+totalMtasEnergy.at(4)) / 10.0, timeDiffBnotB);
 			plot(MTAS_POSITION_ENERGY+373,totalMtasEnergy.at(2) / 10.0, timeDiffBnotB);
-			if (timeDiffBnotB > 300.0 + EPSILON && timeDiffBnotB < 550.0 - EPSILON) {	
-				//std::cout<<"timeDiffBnotB: "<<timeDiffBnotB<<std::endl;
-				if(!betaEnergy_recorded_once){
-					for(int j=0; j<totalMtasEnergy.size(); j++){
-						plot(MTAS_POSITION_ENERGY+250+j, previousEventEnergyBnB.at(j));
-					}
-					plot(MTAS_POSITION_ENERGY+731, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);//plot total vs C energy of the first beta event
-					for(int i=6; i<24; i++){					
-						plot(MTAS_POSITION_ENERGY+730, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);//plot total vs IMO energy of the first beta event
-					}	
-					betaEnergy_recorded_once = true;
+			if (timeDiffBnotB > 300.0 && timeDiffBnotB < 550.0){
+				//the beta is recorded only once, with the first event of its chain falling in the window
+				double windowBegin = lastBeta->time + 300.0 / tenNs;
+				if(history.CountInWindow(windowBegin, actualTime, EventHistory::NOT_BETA) == 0){
+					for(unsigned j=0; j<EventRecord::numEnergies; j++)
+						plot(MTAS_POSITION_ENERGY+250+j, lastBeta->energy[j]);
+					plot(MTAS_POSITION_ENERGY+731, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);
+					for(int i=6; i<24; i++)
+						plot(MTAS_POSITION_ENERGY+730, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);
 				}
-				for(int k=0; k<totalMtasEnergy.size(); k++){
+				for(size_t k=0; k<totalMtasEnergy.size(); k++)
 					plot(MTAS_POSITION_ENERGY+255+k, totalMtasEnergy.at(k));
-				}
-				plot(MTAS_POSITION_ENERGY+733, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);//plot total vs C energy of the second not beta event
-				for(int i=6; i<24; i++){					
-					plot(MTAS_POSITION_ENERGY+732, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);//plot total vs IMO energy of the second not beta event
-				}
-			}			
-		}	
-	}	
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//Time difference between any two events with time difference between more than 10000 ns(10us) and 1st beta only
-	if(isMeasureOn && !isBkgOn && !isLightPulserOn && !isTapeMoveOn /*&& fabs(actualTime + 1.0) > EPSILON*/){
-		//fabs is used to avoid floating point comparison problems
-		if (fabs(time1stBetaonly) > EPSILON && fabs(time2nd_1stBetaOnly) < EPSILON) {
-			time2nd_1stBetaOnly = actualTime; //Update time2nd_1stBetaOnly with the current actualTime for second event right after the very first event
-			std::cout<<"time2nd_1stBetaOnly: "<<time2nd_1stBetaOnly<<std::endl;	
-		}
-		if (fabs(time1stBetaonly) < EPSILON && fabs(time2nd_1stBetaOnly) < EPSILON && isBetaSignal){
-			time1stBetaonly = actualTime; //Update time1stBetaonly with the current actualTime for the very first event
-			nextBetarequired = false;
-			std::cout<<"time1stBetaonly: "<<time1stBetaonly<<std::endl;
-			for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyAny.at(j) = totalMtasEnergy.at(j); //Save the current totalMtasEnergy for 1st event in previousEventEnergyAny
+				plot(MTAS_POSITION_ENERGY+733, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);
+				for(int i=6; i<24; i++)
+					plot(MTAS_POSITION_ENERGY+732, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);
 			}
 		}
-		if(fabs(time1stBetaonly) > EPSILON && fabs(time2nd_1stBetaOnly) > EPSILON ){
-			double timeDiffBAny = (time1stBetaonly - time2nd_1stBetaOnly)*1.0e+8;//fabs((time2nd_1stBetaOnly - time1stBetaonly)*1.0e+8);//calculate time difference in ns /10 for range issue
-			//plot(MTAS_POSITION_ENERGY+701, timeDiffBAny);//plot time difference between two beta events8008000
-			//std::cout<<"timeDiffBAny:111 "<<fabs(timeDiffBAny)<<std::endl;
-			if (fabs(timeDiffBAny) > 4000.0 + EPSILON && !nextBetarequired){
-				plot(MTAS_POSITION_ENERGY+701, timeDiffBAny);//plot time difference between two beta events
-				//std::cout<<"timeDiffBAny:222 "<<timeDiffBAny<<std::endl;
-				for(int j=0; j<totalMtasEnergy.size(); j++){
-					plot(MTAS_POSITION_ENERGY+295+j, previousEventEnergyAny.at(j));//1st beta event hist
-				}
+
+		if(!history.Empty()){
+			const EventRecord &previous = history.Back();
+			double timeDiffany = (actualTime - previous.time) * tenNs;
+
+			//Beta event followed by nothing for more than 40 us
+			if(previous.isBeta && timeDiffany > 4000.0){
+				plot(MTAS_POSITION_ENERGY+701, timeDiffany);
+				for(unsigned j=0; j<EventRecord::numEnergies; j++)
+					plot(MTAS_POSITION_ENERGY+295+j, previous.energy[j]);//1st beta event hist
 				//2d plots
-				plot(MTAS_POSITION_ENERGY+739, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);//plot total vs C energy of the first beta event only
-				for(int i=6; i<24; i++){					
-					plot(MTAS_POSITION_ENERGY+738, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);//plot total vs IMO energy of the first beta event only
-				}	
-				nextBetarequired = true;
-			} 
-			if (isBetaSignal){
-				//std::cout<<"beta_event"<<"others : "<< counter <<std::endl;
-				counter = 0;
-				time2nd_1stBetaOnly = time1stBetaonly; //update time2nd_1stBetaOnly with the current time1stBetaonly
-				time1stBetaonly = actualTime; //update time1stBetaonly with the current time
-				for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyAny.at(j) = totalMtasEnergy.at(j); //Save the current totalMtasEnergy for 1st event in previousEventEnergyAny
-				}
-				nextBetarequired = false;
-			}else{
-				//std::cout<<"not_beta_event"<<std::endl;
-				counter++;
-				time2nd_1stBetaOnly = actualTime; //update time2nd_1stBetaOnly with the current actualTime
+				plot(MTAS_POSITION_ENERGY+739, totalMtasEnergy.at(0) / 10.0, totalMtasEnergy.at(1) / 10.0);
+				for(int i=6; i<24; i++)
+					plot(MTAS_POSITION_ENERGY+738, totalMtasEnergy.at(0) / 10.0, sumFrontBackEnergy.at(i) / 10.0);
 			}
-		}		 
-	}
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//Time difference between any two events with time difference between more than 10000 ns(10us)
-	if(isMeasureOn && !isBkgOn && !isLightPulserOn && !isTapeMoveOn && fabs(actualTime + 1.0) > EPSILON){
-		//fabs is used to avoid floating point comparison problems
-		if (fabs(time1stany) > EPSILON && fabs(time2ndany) < EPSILON) {
-			time2ndany = actualTime; //Update time2ndany with the current actualTime
-		}else if (fabs(time1stany) < EPSILON && fabs(time2ndany) < EPSILON){
-			time1stany = actualTime; //Update time1stany with the current actualTime
-			for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyAny.at(j) = totalMtasEnergy.at(j); //Save the current totalMtasEnergy for 1st event in previousEventEnergyAny
+			//Time difference between any two consecutive events
+			plot(MTAS_POSITION_ENERGY+702, timeDiffany);
+			if (timeDiffany > 1000.0){
+				for(unsigned j=0; j<EventRecord::numEnergies; j++)
+					plot(MTAS_POSITION_ENERGY+290+j, previous.energy[j]);//1st event hist
 			}
 		}
-		if(fabs(time1stany) > EPSILON && fabs(time2ndany) > EPSILON ){
-			double timeDiffany = fabs((time2ndany - time1stany)*100000000.0);//calculate time difference in ns
-			plot(MTAS_POSITION_ENERGY+702, timeDiffany);//plot time difference between two beta events
-			if (timeDiffany > 1000.0 + EPSILON )
-			{
-				for(int j=0; j<totalMtasEnergy.size(); j++){
-				plot(MTAS_POSITION_ENERGY+290+j, previousEventEnergyAny.at(j));//1st beta event hist
-				}
-			}
-			time1stany = time2ndany; //update time1stany with the current time2ndany
-			for(int j=0; j<totalMtasEnergy.size(); j++){
-				previousEventEnergyAny.at(j) = totalMtasEnergy.at(j); //Update previousEventEnergyAny with the current totalMtasEnergy
+
+		history.Add(actualTime, isBetaSignal, totalMtasEnergy);
+
+		//Beta-delayed MTAS: events following any earlier beta within the
+		//correlation window, and in the background window for randoms
+		if(totalMtasEnergy.at(0) > 0){
+			vector<ChainCorrelator::Entry> betas;
+			chains.Correlate(0, ChainCorrelator::BETA_TAG, actualTime, betas);
+			for(vector<ChainCorrelator::Entry>::const_iterator it = betas.begin(); it != betas.end(); it++){
+				double dt_delayed = (actualTime - it->time) * 1.0e6;
+				plot(MTAS_POSITION_ENERGY+740, totalMtasEnergy.at(0) / 10.0, dt_delayed);
+				plot(MTAS_POSITION_ENERGY+743, dt_delayed);
 			}
-			time2ndany = actualTime;//update time2ndany with the current actualTime
+			if(!betas.empty())
+				plot(MTAS_POSITION_ENERGY+741, totalMtasEnergy.at(0));
+			unsigned nrOfRandoms = chains.Count(0, ChainCorrelator::BETA_TAG, actualTime, true);
+			if(nrOfRandoms > 0)
+				plot(MTAS_POSITION_ENERGY+742, totalMtasEnergy.at(0));
 		}
- 
+		if(isBetaSignal)
+			chains.Add(0, ChainCorrelator::BETA_TAG, betaTime, maxSiliconSignal);
+		chains.Expire(actualTime);
 	}
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -868,7 +815,7 @@ MtasProcessor::MtasData::MtasData(ChanEvent *chan){
 	detSubtype = chan->GetChanID().GetSubtype();
 	energy = chan->GetEnergy();
 	calEnergy = chan->GetCalEnergy();
-	time = chan->GetTime();
+	time = chan->GetHighResTime();
 	location = chan->GetChanID().GetLocation();
 }
 
@@ -880,58 +827,87 @@ void MtasProcessor::SetIfOnlyRingBool(){
 	if(!isCenter & !isInner & !isMiddle & isOuter) isOuterOnly = true;
 }
 
-void MtasProcessor::SetCycleState(){
-	//Check flags and set main (static) flags
-
-	//tape		
-	if(isTapeMoveOffSignal && isTapeMoveOnSignal)
-		cout<<"Error: tape movement signal and end of tape movement signal in the same event"<<endl;
-	if(isTapeMoveOnSignal && isTapeMoveOn) 
-		cout<<"Error: No end of tape movement signal in the last tape cicle"<<endl;	
-	if(isTapeMoveOnSignal)
-		isTapeMoveOn = true;
-	if(isTapeMoveOffSignal)
-		isTapeMoveOn = false;
-
-	//measurement  
-	if(isMeasureOffSignal && isMeasureOnSignal)
-		cout<<"Error: measurement signal and no measurement signal in the same event"<<endl;
-	if(isMeasureOnSignal && isMeasureOn) 
-		cout<<"Error: No end of measurement signal in the last tape cicle"<<endl;
-	if(isMeasureOnSignal)
-		isMeasureOn = true;
-	if(isMeasureOffSignal)
-		isMeasureOn = false; 
-
-	//background		
-	if(isBkgOffSignal && isBkgOnSignal)
-		cout<<"Error: background signal and no background signal in the same event"<<endl;
-	if(isBkgOnSignal && isBkgOn) 
-		cout<<"Error: No end of background signal in the last tape cicle"<<endl;
-	if(isBkgOnSignal)
-		isBkgOn = true;
-	if(isBkgOffSignal)
-		isBkgOn = false; 
-		
-	//light pulser	
-	if(isLightPulserOffSignal && isLightPulserOnSignal)
-		cout<<"Error: light pulser signal and no light pulser signal in the same event"<<endl;
-	if(isLightPulserOnSignal && isLightPulserOn) 
-		cout<<"Error: No end of light pulser signal in the last tape cicle"<<endl;
-	if(isLightPulserOnSignal)
-		isLightPulserOn = true;
-	if(isLightPulserOffSignal)
-		isLightPulserOn = false;		
-		
-	//irradiation		
-	if(isIrradOffSignal && isIrradOnSignal)
-		cout<<"Error: irradiation signal and no irradiation signal in the same event"<<endl;	
-	if(isIrradOnSignal && isIrradOn) 
-		cout<<"Error: No end of irradiation signal in the last tape cicle"<<endl;
-	if(isIrradOnSignal)
-		isIrradOn = true;
-	if(isIrradOffSignal)
-		isIrradOn = false;
+void MtasProcessor::SetCycleState(double time){
+	//The state comes from the cycle timeline indexed from all logic signals
+	//of the spill, so it does not depend on the order of processing
+	extern DetectorDriver driver;
+	const CycleTimeline::CycleState &state = driver.cycles.Query(time);
+
+	isTapeMoveOn = state.isTapeMoveOn;
+	isMeasureOn = state.isMeasureOn;
+	isBkgOn = state.isBkgOn;
+	isLightPulserOn = state.isLightPulserOn;
+	isIrradOn = state.isIrradOn;
+	cycleNumber = state.cycleNumber;
+	measureOnTime = state.measureOnTime;
+}
+
+/*! The recovery needs the first pulse energy of the traces, which are then
+ *  filtered for every MTAS channel and not only for the piled up ones.
+ *  Changing the policy should be done before DetectorDriver::Init.
+ */
+void MtasProcessor::SetPileupPolicy(EPileupPolicy policy){
+	pileupPolicy = policy;
+	if(policy == PILEUP_RECOVER)
+		traceProducts |= TraceAnalyzer::FILTERS;
+	else
+		traceProducts &= ~(unsigned)TraceAnalyzer::FILTERS;
+}
+
+/*! Set policy from its name in the PIXIE_PILEUP variable (keep, reject or
+ *  recover), false if it is unknown
+ */
+bool MtasProcessor::ParsePileupPolicy(const string &name, EPileupPolicy &policy){
+	if(name == "keep")
+		policy = PILEUP_KEEP;
+	else if(name == "reject")
+		policy = PILEUP_REJECT;
+	else if(name == "recover")
+		policy = PILEUP_RECOVER;
+	else
+		return false;
+	return true;
+}
+
+/*! Apply the pileup policy to an MTAS channel, returns false if the channel
+ *  is to be left out. Clean channels teach the ratio between the energy of
+ *  the module and the first pulse energy of the trace filter, which scales
+ *  the first pulse of a resolved pileup back to a module energy.
+ */
+bool MtasProcessor::ApplyPileupPolicy(ChanEvent *chan, MtasData &data){
+	using namespace dammIds::mtas;
+	int id = chan->GetID();
+	ChanEvent::EPileup pileup = chan->GetPileup();
+
+	if(pileupPolicy == PILEUP_RECOVER && pileup == ChanEvent::NO_PILEUP){
+		double e1 = chan->GetTraceInfo(TraceAnalyzer::INFO_ENERGY1);
+		if(e1 > 0 && chan->GetEnergy() > 0){
+			pair<double, unsigned> &gain = pileupGain[id];
+			gain.first += chan->GetEnergy() / e1;
+			gain.second++;
+		}
+	}
+
+	if(pileup == ChanEvent::NO_PILEUP || pileupPolicy == PILEUP_KEEP){
+		if(pileup != ChanEvent::NO_PILEUP)
+			plot(MTAS_POSITION_ENERGY+744, 0);
+		return true;
+	}
+
+	if(pileupPolicy == PILEUP_RECOVER && pileup == ChanEvent::PILEUP_RESOLVED){
+		map<int, pair<double, unsigned> >::const_iterator it = pileupGain.find(id);
+		if(it != pileupGain.end() && it->second.second >= minGainHits){
+			extern DetectorDriver driver;
+			double gain = it->second.first / it->second.second;
+			data.energy = gain * chan->GetTraceInfo(TraceAnalyzer::INFO_ENERGY1);
+			data.calEnergy = driver.cal.at(id).Calibrate(data.energy);
+			plot(MTAS_POSITION_ENERGY+744, 2);
+			return true;
+		}
+	}
+
+	plot(MTAS_POSITION_ENERGY+744, 1);
+	return false;
 }
 
 void MtasProcessor::FillMtasMap(){
@@ -943,14 +919,19 @@ void MtasProcessor::FillMtasMap(){
 		if(subtype[0] =='C')
 		    nrOfCentralPMTs ++;
 		if (mtasMap.count(subtype)>0){
-			cout<<"Error: Detector "<<subtype<<" has "<< mtasMap.count(subtype)+1<<" signals in one event"<<endl;
+			PIXIE_LOG(INFO, "MtasProcessor: MTAS detector with several signals",
+				  "Detector " << subtype << " has " << mtasMap.count(subtype)+1
+				  << " signals in one event");
 			continue;//should I skip such events?
 		}
 			
 		if ((*mtasListIt)->GetEnergy() == 0 || (*mtasListIt)->GetEnergy() > 30000)
 				continue;
-				
-		mtasMap.insert(make_pair(subtype,MtasData((*mtasListIt))));
+
+		MtasData data(*mtasListIt);
+		if (!ApplyPileupPolicy(*mtasListIt, data))
+				continue;
+		mtasMap.insert(make_pair(subtype,data));
 		
 		if(maxLocation < (*mtasListIt)->GetChanID().GetLocation())
 			maxLocation = (*mtasListIt)->GetChanID().GetLocation();
@@ -976,7 +957,9 @@ void MtasProcessor::FillSiliMap(){
 	for(vector<ChanEvent*>::const_iterator siliListIt = siliList.begin(); siliListIt != siliList.end(); siliListIt++){
 		string subtype = (*siliListIt)->GetChanID().GetSubtype();
 		if (mtasMap.count(subtype)>0)
-			cout<<"Error: Detector "<<subtype<<" has "<< siliMap.count(subtype)+1<<" signals in one event"<<endl;
+			PIXIE_LOG(INFO, "MtasProcessor: silicon detector with several signals",
+				  "Detector " << subtype << " has " << siliMap.count(subtype)+1
+				  << " signals in one event");
 		
 		Calibration cal = driver.cal.at((*siliListIt)->GetID());
 		if ((*siliListIt)->GetEnergy() < 200 || (*siliListIt)->GetEnergy() > 30000) {
@@ -990,7 +973,7 @@ void MtasProcessor::FillSiliMap(){
             maxSiliconSignal = siliSummary->GetMaxEvent()->GetCalEnergy();//Jan 03 2011 Ola K
             if(maxSiliconSignal > 2.0) {
                 isBetaSignal = true;
-                betaTime = siliSummary->GetMaxEvent()->GetTime() * pixie::clockInSeconds;
+                betaTime = siliSummary->GetMaxEvent()->GetHighResTime() * pixie::clockInSeconds;
             }
 	}
 }
@@ -1057,15 +1040,15 @@ void MtasProcessor::FillLogicMap(){
 	for(vector<ChanEvent*>::const_iterator logiListIt = logiList.begin(); logiListIt != logiList.end(); logiListIt++){
 		string subtype = (*logiListIt)->GetChanID().GetSubtype();
 		if (logiMap.count(subtype)>0)
-			cout<<"Error: Detector "<<subtype<<" has "<< logiMap.count(subtype)+1<<" signals in one event"<<endl;
+			PIXIE_LOG(INFO, "MtasProcessor: logic signal with several signals",
+				  "Detector " << subtype << " has " << logiMap.count(subtype)+1
+				  << " signals in one event");
 		logiMap.insert(make_pair(subtype,MtasData(((*logiListIt)))));
 		
 		//set logic flags
 		if((*logiListIt)->GetEnergy() > logicTreshold){
 			if(subtype == "TRU") {
 				isTriggerOnSignal = true;
-				measureOnTime = (*logiListIt)->GetTime() * pixie::clockInSeconds;
-				cycleNumber ++;
 				logicSignalsValue +=1;
 			}
 			
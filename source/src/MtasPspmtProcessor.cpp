@@ -54,6 +54,7 @@ MtasPspmtProcessor::MtasPspmtProcessor() : EventProcessor()
 {
     name = "mtaspspmt";
     associatedTypes.insert("mtaspspmt");
+    priority = PRIORITY_LOW; // imaging only
 }
 
 //bool MtasPspmtProcessor::Init(DetectorDriver &driver, const string &ConfigFile)
@@ -0,0 +1,158 @@
+/*! \file PixelCorrelator.cpp
+ *
+ *  Implant/decay correlations on a sparse pixel grid. Pixels are kept in a
+ *  hash table so that fine grids (256x256 and more) of continuous positions
+ *  from the PSPMT detectors cost memory only for the pixels with a live
+ *  implant.
+ */
+
+#include <cmath>
+
+#include "param.h"
+#include "PixelCorrelator.h"
+
+using namespace std;
+
+/*! The grid covers [0, xRange) x [0, yRange) with nx x ny pixels. The times
+ *  default to the ones of the strip correlator.
+ */
+PixelCorrelator::PixelCorrelator(unsigned nx, unsigned ny,
+				 double xRange, double yRange,
+				 unsigned radius, size_t maxImplants) :
+    nx(nx), ny(ny), xScale(nx / xRange), yScale(ny / yRange),
+    radius(radius), maxImplants(maxImplants),
+    decayTime(-1.), lastImplantKey(0)
+{
+    SetTimes(5e-3, 3300);
+}
+
+/*! Set the minimum time between implants in a pixel and the maximum
+ *  implant-decay time, both in seconds
+ */
+void PixelCorrelator::SetTimes(double minImplantTime, double correlationTime)
+{
+    minImpTime = minImplantTime / pixie::clockInSeconds;
+    corrTime   = correlationTime / pixie::clockInSeconds;
+}
+
+/*! Correlate an implant or decay at position (x, y) and time (in pixie
+ *  clocks) and return the resulting condition
+ */
+Correlator::EConditions PixelCorrelator::Correlate(Correlator::EEventType type,
+						   double x, double y,
+						   double time)
+{
+    unsigned key;
+    if (!GetKey(x, y, key))
+	return Correlator::INVALID_LOCATION;
+
+    Expire(time);
+
+    if (type == Correlator::IMPLANT_EVENT) {
+	Correlator::EConditions condition = Correlator::VALID_IMPLANT;
+	ImplantData &imp = implants[key];
+	if (imp.implanted) {
+	    condition = Correlator::BACK_TO_BACK_IMPLANT;
+	    imp.dtime = time - imp.time;
+	} else {
+	    imp.implanted = true;
+	    imp.dtime = INFINITY;
+	}
+	imp.time = time;
+	order.push_back(make_pair(time, key));
+	if (implants.size() > maxImplants)
+	    Expire(time);
+	else if (order.size() > 2 * implants.size())
+	    Compact();
+	return condition;
+    } else if (type == Correlator::DECAY_EVENT) {
+	int px = key % nx;
+	int py = key / nx;
+	int r = radius;
+	const ImplantData *found = NULL;
+	unsigned foundKey = 0;
+
+	for (int ix = max(px - r, 0); ix <= min(px + r, int(nx) - 1); ix++) {
+	    for (int iy = max(py - r, 0); iy <= min(py + r, int(ny) - 1); iy++) {
+		unsigned k = iy * nx + ix;
+		unordered_map<unsigned, ImplantData>::const_iterator it =
+		    implants.find(k);
+		if (it == implants.end() || it->second.time > time)
+		    continue;
+		if (found == NULL || it->second.time > found->time) {
+		    found = &it->second;
+		    foundKey = k;
+		}
+	    }
+	}
+
+	if (found == NULL)
+	    return Correlator::DECAY_TOO_LATE;
+	if (found->dtime < minImpTime)
+	    return Correlator::IMPLANT_TOO_SOON;
+	decayTime = time - found->time;
+	lastImplantKey = foundKey;
+	return Correlator::VALID_DECAY;
+    }
+
+    return Correlator::UNKNOWN_EVENT;
+}
+
+/*! Pixel of the implant correlated with the last valid decay */
+pair<unsigned, unsigned> PixelCorrelator::GetImplantPixel(void) const
+{
+    return make_pair(lastImplantKey % nx, lastImplantKey / nx);
+}
+
+/*! Remove the implants which can not be correlated any more at the given
+ *  time, and the oldest ones while more than maxImplants are stored.
+ *  Entries of the order queue belonging to a pixel which has been
+ *  implanted again since are skipped.
+ */
+void PixelCorrelator::Expire(double time)
+{
+    while (!order.empty()) {
+	const pair<double, unsigned> &oldest = order.front();
+	if (time - oldest.first < corrTime && implants.size() <= maxImplants)
+	    break;
+	unordered_map<unsigned, ImplantData>::iterator it =
+	    implants.find(oldest.second);
+	if (it != implants.end() && it->second.time == oldest.first)
+	    implants.erase(it);
+	order.pop_front();
+    }
+}
+
+/*! Drop the entries of the order queue belonging to a pixel which has been
+ *  implanted again since, keeping the others in time order
+ */
+void PixelCorrelator::Compact(void)
+{
+    deque< pair<double, unsigned> > live;
+    for (deque< pair<double, unsigned> >::const_iterator it = order.begin();
+	 it != order.end(); it++) {
+	unordered_map<unsigned, ImplantData>::const_iterator imp =
+	    implants.find(it->second);
+	if (imp != implants.end() && imp->second.time == it->first)
+	    live.push_back(*it);
+    }
+    order.swap(live);
+}
+
+void PixelCorrelator::Clear(void)
+{
+    implants.clear();
+    order.clear();
+}
+
+bool PixelCorrelator::GetKey(double x, double y, unsigned &key) const
+{
+    if (!(x >= 0) || !(y >= 0))
+	return false;
+    unsigned ix = unsigned(x * xScale);
+    unsigned iy = unsigned(y * yScale);
+    if (ix >= nx || iy >= ny)
+	return false;
+    key = iy * nx + ix;
+    return true;
+}
@@ -36,6 +36,7 @@
 #include <string>
 #include <vector>
 
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 
@@ -43,7 +44,13 @@
 #include <sys/times.h>
 
 #include "DetectorDriver.h"
+#include "Logger.h"
+#include "PixieHeader.h"
+#include "Profiler.h"
 #include "RawEvent.h"
+#include "SpillDecoder.h"
+#include "SpillQueue.h"
+#include "Telemetry.h"
 #include "damm_plotids.h"
 #include "param.h"
 #include "pixie16app_defs.h"
@@ -58,15 +65,36 @@ using pixie::word_t;
  */
 vector<Identifier> modChan;
 
+/**
+ * Logger of the diagnostics, defined first so that it outlives everything
+ * which may log
+ */
+Logger logger;
+
 /**
  * Contains event information, the information is filled in ScanList() and is 
  * referenced externally in DetectorDriver.cpp, particularly in ProcessEvent()
  */
 RawEvent rawev;
 
+/**
+ * Profiler of the whole scan, defined before the driver so that it outlives
+ * the processors which report their time when they are destroyed
+ */
+Profiler profiler;
+
 /** Driver used to process the raw events */
 DetectorDriver driver;
 
+/** Decoder of the module buffers of a spill on worker threads */
+SpillDecoder spillDecoder;
+
+/** Spills waiting for the analysis thread in live mode */
+SpillQueue spillQueue;
+
+/** Throughput counters, written out for the dashboards if asked for */
+Telemetry telemetry;
+
 /** The max number of modules used in the map.txt file */
 unsigned int numModules;
 
@@ -84,6 +112,11 @@ void HistoStats(unsigned int, double, double, HistoPoints);
  */
 void hissub_sec(unsigned int *ibuf[],unsigned int *nhw);
 bool MakeModuleData(const word_t *data, unsigned long nWords); 
+void StartLiveMode(void);
+void StartTelemetry(void);
+void StartResync(void);
+void StartFirmware(void);
+void DeliverSpill(const word_t *data, unsigned long nWords);
 #endif
 
 int ReadBuffData(word_t *lbuf, unsigned long *BufLen,
@@ -99,7 +132,7 @@ const string scanMode = "scan";
  */
 bool Compare(const ChanEvent *a, const ChanEvent *b)
 {
-    return (a->GetTime() < b->GetTime());
+    return (a->GetHighResTime() < b->GetHighResTime());
 }
 
 /** \fn extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw) 
@@ -143,10 +176,19 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
     // keep track of the number of bad spills
     static unsigned int spillInvalidCount = 0, spillValidCount = 0;
     static bool firstTime = true;
+    static bool liveChecked = false;
     // might take a few entries into this function to get all the buffers in a spill
     static unsigned int bufInSpill = 0;    
     static unsigned int dataWords = 0;
     
+    if (!liveChecked) {
+	StartLiveMode();
+	StartTelemetry();
+	StartResync();
+	StartFirmware();
+	liveChecked = true;
+    }
+
     /*Assign ibuf variable to local variable for use in function */
     word_t *buf=(word_t*)sbuf;
     
@@ -159,7 +201,8 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
 
     // Check to make sure the number of buffers is not excessively large 
     if (totBuf > maxChunks) {
-	cout << "LARGE TOTNUM = " << bufNum << endl;
+	PIXIE_LOG(ERROR, "hissub_: too many chunks",
+		  "Large total number of chunks " << totBuf << " at chunk " << bufNum);
 	return;
     }
 
@@ -169,15 +212,16 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
     if(bufNum != 0 && firstTime) {
 	do {
 	    if (buf[totWords] == U_DELIMITER) {
-		cout << "  -1 DELIMITER, " 
-		     << buf[totWords] << buf[totWords + 1] << endl;
+		PIXIE_LOG(WARNING, "hissub_: delimiter before the first spill",
+			  "-1 delimiter, " << buf[totWords] << buf[totWords + 1]);
 		return;
 	    }
 	    nWords = buf[totWords] / 4;
 	    totBuf = buf[totWords+1];
 	    bufNum = buf[totWords+2];
 	    totWords += nWords+1;
-	    cout << "SKIP " << bufNum << " of " << totBuf << endl;
+	    PIXIE_LOG(INFO, "hissub_: chunk skipped before the first spill",
+		      "Skip chunk " << bufNum << " of " << totBuf);
 	} while(nWords != 5);
     }
     firstTime = false;
@@ -194,15 +238,17 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
  	    bufNum = buf[totWords+2]; 
 	    // read total number of buffers later after we check if the last spill was good
 	    if (lastBuf != U_DELIMITER && bufNum != lastBuf + 1) {
-		cout << "Buffer skipped, Last: " << lastBuf << " of " << totBuf 
-		     << " (" << bufInSpill << ") read -- Now: " << bufNum << endl;
+		PIXIE_LOG(WARNING, "hissub_: chunk skipped",
+			  "Chunk skipped, last: " << lastBuf << " of " << totBuf
+			  << " (" << bufInSpill << ") read -- now: " << bufNum);
 		// if we are only missing the vsn 9999 terminator, reconstruct it
 		if (lastBuf + 2 == totBuf && bufInSpill == totBuf - 1) {
-		    cout << "  Reconstructing final buffer " << lastBuf + 1 << "." << endl;
+		    PIXIE_LOG(INFO, "hissub_: final chunk reconstructed",
+			      "Reconstructing final chunk " << lastBuf + 1);
 		    totData[dataWords++] = 2;
 		    totData[dataWords++] = 9999;
 		    
-		    MakeModuleData(totData, dataWords);
+		    DeliverSpill(totData, dataWords);
 		    spillValidCount++;
 		    bufInSpill = 0; dataWords = 0; lastBuf = -1;
 		} else if (bufNum == 0) {
@@ -211,19 +257,22 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
 //			 << "\n  " << spillValidCount << " valid spills so far."
 //			 << " Starting fresh spill." << endl;
 		    // throw away previous collected data and start fresh
+		    telemetry.Count(Telemetry::INCOMPLETE_SPILLS);
 		    bufInSpill = 0; dataWords = 0; lastBuf = -1;
 		}
 	    } // check that the chunks are in order
 	    // update the total chunks only after the sanity checks above
 	    totBuf = buf[totWords+1];
 	    if (totBuf > maxChunks) {
-		cout << "EEEEE LOST DATA: Total buffers = " << totBuf 
-		     <<  ", word count = " << nWords << endl;
+		PIXIE_LOG(ERROR, "hissub_: too many chunks in the spill",
+			  "Lost data: total chunks = " << totBuf
+			  << ", word count = " << nWords);
 		return;
 	    }
 	    if (bufNum > totBuf - 1) {
-		cout << "EEEEEEE LOST DATA: Buffer number " << bufNum
-		     << " of total buffers " << totBuf << endl;
+		PIXIE_LOG(ERROR, "hissub_: chunk number out of range",
+			  "Lost data: chunk number " << bufNum
+			  << " of total chunks " << totBuf);
 		return;
 	    }
 	    lastBuf = bufNum;
@@ -231,7 +280,8 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
 	    /* Increment the number of buffers in a spill*/
 	    bufInSpill++;
 	    if(nWords == 0) {
-		cout << "EEEEEEEEEEEEEEEEEEEEEEEEEEEEEEE NWORDS 0" << endl;
+		PIXIE_LOG(ERROR, "hissub_: empty chunk",
+			  "Chunk " << bufNum << " of " << totBuf << " has no words");
 		return;
 	    }
 	    
@@ -243,13 +293,14 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
 	    // one extra word to pass over "-1" delimiter signalling end of buffer
 	    totWords += nWords+1;
 	    if (bufNum == totBuf - 1 && nWords != 5) {
-		cout << "Strange final buffer " << bufNum << " of " << totBuf
-		     << " with " << nWords << " words" << endl;
+		PIXIE_LOG(WARNING, "hissub_: strange final chunk",
+			  "Strange final chunk " << bufNum << " of " << totBuf
+			  << " with " << nWords << " words");
 	    }
 	    if (nWords == 5 && bufNum != totBuf - 1) {
-		cout << "Five word buffer " << bufNum << " of " << totBuf
-		     << " WORDS: " 
-		     << hex << buf[3] << " " << buf[4] << dec << endl;
+		PIXIE_LOG(WARNING, "hissub_: five word chunk inside the spill",
+			  "Five word chunk " << bufNum << " of " << totBuf
+			  << " words: " << hex << buf[3] << " " << buf[4]);
 	    }
 	} while(nWords != 5 || bufNum != totBuf - 1);
 	/* reached the end of a spill when nwords = 5 and last chunk in spill */
@@ -264,21 +315,176 @@ extern "C" void hissub_(unsigned short *sbuf[],unsigned short *nhw)
 //		 << buf[2] << " " << buf[3]
 //		 << "\n| " << dec << buf[totWords] << " " << buf[totWords+1] << "  "
 //		 << buf[totWords+2] << " " << buf[totWords+3] << endl;
+	    telemetry.Count(Telemetry::INCOMPLETE_SPILLS);
 	} else {
 	    spillValidCount++;
-	    MakeModuleData(totData, dataWords);	    
+	    DeliverSpill(totData, dataWords);	    
 	} // else the number of buffers is complete
 	dataWords = 0; bufInSpill = 0; lastBuf = -1; // reset the number of buffers recorded
     } while (totWords < nhw[0] / 4);
 }
 
+/** \brief analysis of a spill taken from the live mode queue
+ *
+ * With the decimate policy the driver sheds load according to the backlog
+ * of the queue, true is returned if it did for this spill.
+ */
+static bool AnalyzeLiveSpill(const word_t *data, size_t nWords, double backlog)
+{
+    using namespace dammIds::misc;
+
+    unsigned shedLevel = driver.SetBacklog(backlog);
+    size_t capacity = spillQueue.GetCapacity();
+    plot(DD_SPILL_QUEUE, 100 * spillQueue.GetOccupancy() / capacity, shedLevel);
+    MakeModuleData(data, nWords);
+    return shedLevel > 0;
+}
+
+/** \brief start the live mode if requested
+ *
+ * With PIXIE_LIVE set to block, drop or decimate in the environment the
+ * reassembled spills are queued for an analysis thread, so that scanor
+ * keeps reading the acquisition. The value is the policy when the queue is
+ * full, PIXIE_LIVE_CAPACITY the number of spills it holds.
+ */
+void StartLiveMode(void)
+{
+    const size_t defaultCapacity = 16;
+
+    const char *live = getenv("PIXIE_LIVE");
+    if (live == NULL || *live == '\0')
+	return;
+
+    SpillQueue::EPolicy policy;
+    if (!SpillQueue::ParsePolicy(live, policy)) {
+	cout << "Unknown PIXIE_LIVE policy '" << live
+	     << "', use block, drop or decimate. Not running live." << endl;
+	return;
+    }
+    size_t capacity = defaultCapacity;
+    const char *capacityVar = getenv("PIXIE_LIVE_CAPACITY");
+    if (capacityVar != NULL && atoi(capacityVar) > 0)
+	capacity = atoi(capacityVar);
+
+    if (spillQueue.Start(policy, capacity, AnalyzeLiveSpill))
+	cout << "Live mode: up to " << capacity << " spills queued, "
+	     << SpillQueue::GetPolicyName(policy) << " when full" << endl;
+}
+
+/** \brief write the telemetry if requested
+ *
+ * With PIXIE_TELEMETRY set to a file name the throughput counters are
+ * written to that file in the Prometheus text format every
+ * PIXIE_TELEMETRY_INTERVAL seconds, 10 by default.
+ */
+void StartTelemetry(void)
+{
+    const double defaultInterval = 10;
+
+    const char *fileName = getenv("PIXIE_TELEMETRY");
+    if (fileName == NULL || *fileName == '\0')
+	return;
+
+    double interval = defaultInterval;
+    const char *intervalVar = getenv("PIXIE_TELEMETRY_INTERVAL");
+    if (intervalVar != NULL && atof(intervalVar) > 0)
+	interval = atof(intervalVar);
+
+    if (telemetry.Open(fileName, interval))
+	cout << "Telemetry written to " << fileName << " every " << interval
+	     << " s" << endl;
+}
+
+/** \brief choose between resynchronizing on corrupt data and throwing
+ * the spill away
+ *
+ * Corrupt data are skipped up to the next valid module record or channel
+ * header unless PIXIE_RESYNC is set to 0, in which case a spill with a bad
+ * record or module buffer is thrown away whole.
+ */
+void StartResync(void)
+{
+    const char *resync = getenv("PIXIE_RESYNC");
+    if (resync != NULL && strcmp(resync, "0") == 0) {
+	readbuff::SetResync(false);
+	cout << "Spills with corrupt data are thrown away" << endl;
+    }
+}
+
+/** \brief set the firmware revision of the modules
+ *
+ * PIXIE_FIRMWARE gives the default revision (a, d or f), followed by the
+ * modules running another one, e.g. "d,4:f,5:f". Without it all modules
+ * run the revision the scan was built for.
+ */
+void StartFirmware(void)
+{
+    const char *firmware = getenv("PIXIE_FIRMWARE");
+    if (firmware == NULL || *firmware == '\0')
+	return;
+
+    if (readbuff::SetFirmwares(firmware))
+	cout << "Firmware: " << firmware << endl;
+    else
+	cout << "Unknown PIXIE_FIRMWARE '" << firmware << "', use a, d or f "
+	     << "followed by module:revision for single modules, e.g. d,4:f. "
+	     << "Modules run "
+	     << readbuff::GetFirmwareName(readbuff::GetDefaultFirmware())
+	     << " firmware." << endl;
+}
+
+/** \brief pass a reassembled spill to the analysis, through the queue in
+ * live mode
+ */
+void DeliverSpill(const word_t *data, unsigned long nWords)
+{
+    telemetry.Count(Telemetry::SPILLS);
+    if (spillQueue.IsRunning())
+	spillQueue.Push(data, nWords);
+    else
+	MakeModuleData(data, nWords);
+}
+
+const unsigned int maxVsn = 14; // no more than 14 pixie modules per crate
+
+/** \brief true if a sane module record starts at inWords, i.e. its length
+ * and vsn are in range and it ends within the spill
+ */
+static bool SaneRecord(const word_t *data, unsigned long inWords,
+		       unsigned long nWords)
+{
+    word_t lenRec = data[inWords];
+    word_t vsn    = data[inWords+1];
+    return lenRec >= 2 && lenRec <= maxWords &&
+	(vsn <= maxVsn || vsn == 9999) && inWords + lenRec <= nWords;
+}
+
+/** \brief position of the next module record after a bad one at inWords,
+ * nWords if there is none. The record must be followed by another sane
+ * one or end the spill.
+ */
+static unsigned long ResyncRecord(const word_t *data, unsigned long inWords,
+				  unsigned long nWords)
+{
+    for (unsigned long next = inWords + 1; next + 1 < nWords; next++) {
+	if (!SaneRecord(data, next, nWords))
+	    continue;
+	unsigned long after = next + data[next];
+	if (after == nWords || (after + 1 < nWords &&
+				SaneRecord(data, after, nWords)))
+	    return next;
+    }
+    return nWords;
+}
+
 /** \brief inserts a delimiter in between individual module data and at end of 
  * buffer. Data is then passed to hissub_sec() for processing.
+ *
+ * A record failing the sanity check is skipped up to the next sane one in
+ * resync mode (see readbuff::SetResync()), otherwise the spill is rejected.
  */
 bool MakeModuleData(const word_t *data, unsigned long nWords)
 {
-    const unsigned int maxVsn = 14; // no more than 14 pixie modules per crate
-
     unsigned int inWords = 0, outWords = 0;
     
     static word_t modData[TOTALREAD];
@@ -289,12 +495,24 @@ bool MakeModuleData(const word_t *data, unsigned long nWords)
 	word_t lenRec = data[inWords];	
         word_t vsn    = data[inWords+1];
 	/* Check sanity of record length and vsn*/
-	if(lenRec > maxWords || (vsn > maxVsn && vsn != 9999)) { 
-	    cout << "SANITY CHECK FAILED: lenRec = " << lenRec
-		 << ", vsn = " << vsn << ", inWords = " << inWords
-		 << " of " << nWords << ", outWords = " << outWords << endl;
+	if (!SaneRecord(data, inWords, nWords)) { 
+	    PIXIE_LOG(ERROR, "MakeModuleData: record sanity check failed",
+		      "Sanity check failed: lenRec = " << lenRec
+		      << ", vsn = " << vsn << ", inWords = " << inWords
+		      << " of " << nWords << ", outWords = " << outWords);
 	    // exit(EXIT_FAILURE);
-	    return false;  
+	    if (!readbuff::GetResync()) {
+		telemetry.Count(Telemetry::REJECTED_SPILLS);
+		return false;
+	    }
+	    unsigned long next = ResyncRecord(data, inWords, nWords);
+	    PIXIE_LOG(WARNING, "MakeModuleData: resynchronized",
+		      "Skipped " << next - inWords << " words of the spill to "
+		      << ((next < nWords) ? "the next module record" : "its end"));
+	    telemetry.Count(Telemetry::RESYNCS);
+	    telemetry.Count(Telemetry::DROPPED_WORDS, next - inWords);
+	    inWords = next;
+	    continue;
 	}
 	
 	/*Extract the data from TotData and place into ModData*/	      
@@ -312,13 +530,18 @@ bool MakeModuleData(const word_t *data, unsigned long nWords)
 	cout << "Values of nn - " << nWords << " nk - "<< inWords  
 	     << " mm - " << outWords << " TOTALREAD - " << TOTALREAD << endl;
 	Pixie16Error(2); 
+	telemetry.Count(Telemetry::REJECTED_SPILLS);
 	return false;
     }
 
     //! shouldn't this be 4 * outWords
     unsigned int nhw = 8 * outWords; // calculate the number of half short ints
 
-    hissub_sec(&dataPtr, &nhw);
+    {
+	Profiler::Scope scope(Profiler::SPILL);
+	hissub_sec(&dataPtr, &nhw);
+    }
+    telemetry.Update();
 
     return true;
 }
@@ -330,7 +553,8 @@ bool MakeModuleData(const word_t *data, unsigned long nWords)
  * reconstructed buffer.  Specifically, it retrieves channel information
  * and places the channel information into a list of channels that triggered in
  * this spill.  The list of channels is sorted according to the event time
- * assigned to each channel by Pixie16 and the sorted list is passed to
+ * assigned to each channel by Pixie16, refined by the CFD in the
+ * TimingEngine, and the sorted list is passed to
  * ScanList() for raw event creation. 
  *
  * If the old pixie readout is used then this function is
@@ -381,6 +605,9 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
     lbuf=(word_t *)ibuf; //old readout
 #endif
 
+    // channels indexed in a previous call point to a buffer which is gone
+    spillDecoder.Clear();
+
     /* Initialize the scan program before the first event */
     if (counter==0) {
         /* Retrieve the current time for use later to determine the total
@@ -453,18 +680,26 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
 	        if ( lastVsn != U_DELIMITER) {
 		    // the modules should be read out cyclically
 		    if ( ((lastVsn+1) % numModules) != vsn ) {
-			cout << " MISSING BUFFER " << vsn
-			     << " -- lastVsn = " << lastVsn << "  " 
-			     << ", length = " << lenRec << endl;
-                        RemoveList(eventList);
+			PIXIE_LOG(WARNING, "hissub_sec: missing module buffer",
+				  "Missing buffer " << vsn << " -- lastVsn = "
+				  << lastVsn << ", length = " << lenRec);
+			telemetry.Count(Telemetry::MISSING_BUFFERS);
+			// the buffers read so far are kept in resync mode
+			if (!readbuff::GetResync()) {
+			    RemoveList(eventList);
+			    spillDecoder.Clear();
+			}
                         fullSpill=true;
                     }
                 }
-                /* Read the buffer.  After read, the vector eventList will 
-		   contain pointers to all channels that fired in this buffer
+                /* Index the buffer.  The channels that fired in this
+		   buffer are decoded into eventList once the spill is
+		   complete, all modules at once
                 */
 
-                retval= ReadBuffData(&lbuf[nWords],&bufLen,eventList);
+                uint64_t decodeBegin = Profiler::Now();
+                retval= spillDecoder.Add(&lbuf[nWords],&bufLen);
+                profiler.Add(Profiler::DECODE, Profiler::Now() - decodeBegin);
 
                 
                 /* If the return value is less than the error code, 
@@ -472,11 +707,22 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
 		   Print error message and reset variables if necessary
                 */
                 if ( retval <= readbuff::ERROR ) {
-		    cout << " READOUT PROBLEM " << retval 
-			 << " in event " << counter << endl;
+		    PIXIE_LOG(ERROR, "hissub_sec: readout problem",
+			      "Readout problem " << retval << " in call " << counter
+			      << ", buffer " << vsn << " after " << lastVsn
+			      << (readbuff::GetResync() ? ", the buffer is removed"
+				  : ", the spill is removed"));
+		    telemetry.Count(Telemetry::READOUT_ERRORS);
+		    if ( readbuff::GetResync() ) {
+			// only this buffer is lost, its channels were dropped
+			telemetry.Count(Telemetry::DROPPED_WORDS, lenRec);
+			nWords += lenRec + 1;
+			lastVsn = vsn;
+			continue;
+		    }
                     if ( retval == readbuff::ERROR ) {
-			cout << "  Remove list " << lastVsn << " " << vsn << endl;
                         RemoveList(eventList); 	                        
+                        spillDecoder.Clear();
                     }
                     return;
                 } else if ( retval == 0 ) {
@@ -495,10 +741,21 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
                 */
                 lastVsn = vsn;
                 nWords += lenRec+1; // one extra word for delimiter
-            } else break; // bail out if we have lost our place (bad vsn) and process events            
+            } else if ( vsn != 9999 && readbuff::GetResync() ) {
+		/* the records were checked by MakeModuleData(), so skip the
+		   one of the bad vsn to the next delimiter
+		*/
+		PIXIE_LOG(WARNING, "hissub_sec: bad vsn",
+			  "Buffer of bad vsn " << vsn << " after " << lastVsn
+			  << " skipped, length = " << lenRec);
+		telemetry.Count(Telemetry::RESYNCS);
+		telemetry.Count(Telemetry::DROPPED_WORDS, lenRec);
+		nWords += lenRec + 1;
+	    } else break; // bail out if we have lost our place (bad vsn) and process events            
         } // while still have words
 	if (nWords > nhw[0] / 2 - 6) {
-	    cout << "This actually happens!" << endl;	    
+	    PIXIE_LOG(WARNING, "hissub_sec: read past the end of the spill",
+		      "Read " << nWords << " words past the end of the spill");
 	}
         
         /* If the vsn is 9999 this is the end of a spill, signal this buffer
@@ -508,7 +765,8 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
             fullSpill = true;
             nWords += 3;//skip it
             if (lbuf[nWords+1] != U_DELIMITER) {
-		cout << "this actually happens!" << endl;
+		PIXIE_LOG(WARNING, "hissub_sec: spill continues in the buffer",
+			  "Another spill follows in the same buffer");
                 multSpill = true;
             }
             lastVsn=U_DELIMITER;
@@ -517,16 +775,41 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
         /* if there are events to process, continue */
         if( numEvents>0 ) {
 	    if (fullSpill) { 	  // if full spill process events
+		// decode the channels of all the modules of the spill
+		{
+		    Profiler::Scope scope(Profiler::DECODE);
+		    spillDecoder.Decode(eventList);
+		}
+		telemetry.Count(Telemetry::HITS, eventList.size());
+
+		/* index the logic signals of the whole spill in the cycle
+		   timeline before any event is built, so that the cycle
+		   state of an event does not depend on the processing order
+		*/
+		for (vector<ChanEvent*>::const_iterator it = eventList.begin();
+		     it != eventList.end(); it++)
+		    driver.cycles.Index(*it);
+
+		// refine the time of each channel with the CFD
+		{
+		    Profiler::Scope scope(Profiler::TIMING);
+		    driver.timing.Process(eventList);
+		}
+
 		// sort the vector of pointers eventlist according to time
 		
-		sort(eventList.begin(),eventList.end(),Compare);
+		{
+		    Profiler::Scope scope(Profiler::SORT);
+		    sort(eventList.begin(),eventList.end(),Compare);
+		}
 		
 		/* once the vector of pointers eventlist is sorted based on time,
 		   begin the event processing in ScanList()
 		*/
 		ScanList(eventList);
 		if( retval<0 ) {
-		    cout << "scan list error " << retval << endl;
+		    PIXIE_LOG(ERROR, "hissub_sec: scan list error",
+			      "Scan list error " << retval);
 		    return;
 		}
 		
@@ -552,15 +835,19 @@ extern "C" void hissub_(unsigned short *ibuf[],unsigned short *nhw)
 			 << (tmsNow.tms_stime - tmsBegin.tms_stime) / hz
 			 << ", real time = "
 			 << (clockNow - clockBegin) / hz << endl;
+		    profiler.Report(cout);
 		}		
 	    } // end fullSpill 
 	    else {
-		cout << "Spill split between buffers" << endl;
+		PIXIE_LOG(WARNING, "hissub_sec: spill split between buffers",
+			  "Spill split between buffers, " << numEvents
+			  << " channels thrown away");
 		return; //! this tosses out all events read into the vector so far
 	    }	    
         }  // end numEvents > 0
         else {
-	    cout << "bad buffer, numEvents = " << numEvents << endl;
+	    PIXIE_LOG(WARNING, "hissub_sec: spill without channels",
+		      "Bad buffer, numEvents = " << numEvents);
             return;
         }
         
@@ -616,17 +903,26 @@ void ScanList(vector<ChanEvent*> &eventList)
     double diffTime = 0;
     
     //set last_t to the time of the first event
-    double lastTime = (*iEvent)->GetTime();
+    double lastTime = (*iEvent)->GetHighResTime();
     double currTime = lastTime;
     unsigned int id = (*iEvent)->GetID();
 
-    HistoStats(id, diffTime, lastTime, BUFFER_START);
+    // the build stage is the time spent here outside of the event processing
+    uint64_t buildBegin = Profiler::Now();
+    uint64_t processTime = 0;
+    unsigned long numBuilt = 0; // events passed to the driver
+
+    // the diagnostic spectra are the first to go when shedding load
+    bool histoStats = (driver.GetShedLevel() == 0);
+    if (histoStats)
+	HistoStats(id, diffTime, lastTime, BUFFER_START);
 
     //loop over the list of channels that fired in this buffer
     for(; iEvent != eventList.end(); iEvent++) { 
 	id        = (*iEvent)->GetID();
 	if (id == U_DELIMITER) {
-	  cout << "pattern 0 ignore" << endl;
+	  PIXIE_LOG(WARNING, "ScanList: channel without id",
+		    "Pattern 0 ignored");
 	  continue;
 	}
 	if (id > numModules * NUMBER_OF_CHANNELS) {
@@ -644,7 +940,7 @@ void ScanList(vector<ChanEvent*> &eventList)
        /* retrieve the current event time and determine the time difference 
 	   between the current and previous events. 
         */
-	currTime = (*iEvent)->GetTime();
+	currTime = (*iEvent)->GetHighResTime();
         diffTime = currTime - lastTime;
 
         /* if the time difference between the current and previous event is 
@@ -656,15 +952,20 @@ void ScanList(vector<ChanEvent*> &eventList)
 		/* detector driver accesses rawevent externally in order to
 		   have access to proper detector_summaries
 		*/
+                uint64_t processBegin = Profiler::Now();
                 driver.ProcessEvent(scanMode);
+                processTime += Profiler::Now() - processBegin;
+		numBuilt++;
             }
  
             //after processing zero the rawevent variable
             rawev.Zero(usedDetectors);
             usedDetectors.clear();	    
 
-	    HistoStats(id, diffTime, currTime, EVENT_START);
-	} else HistoStats(id, diffTime, currTime, EVENT_CONTINUE);
+	    if (histoStats)
+		HistoStats(id, diffTime, currTime, EVENT_START);
+	} else if (histoStats)
+	    HistoStats(id, diffTime, currTime, EVENT_CONTINUE);
 	plot(id + dammIds::misc::offsets::D_TIME, eventTime - chanTime);
 
 	usedDetectors.insert(modChan[id].GetType());
@@ -676,11 +977,18 @@ void ScanList(vector<ChanEvent*> &eventList)
     //process the last event in the buffer
     if( rawev.Size()>0 ) {
 	string mode;
-        HistoStats(id, diffTime, currTime, BUFFER_END);
+	if (histoStats)
+	    HistoStats(id, diffTime, currTime, BUFFER_END);
 
+	uint64_t processBegin = Profiler::Now();
 	driver.ProcessEvent(scanMode);
+	processTime += Profiler::Now() - processBegin;
+	numBuilt++;
 	rawev.Zero(usedDetectors);
     }
+
+    profiler.Add(Profiler::BUILD, Profiler::Now() - buildBegin - processTime);
+    telemetry.Count(Telemetry::EVENTS, numBuilt);
 }
 
 /**
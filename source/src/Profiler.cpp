@@ -0,0 +1,146 @@
+/** \file Profiler.cpp
+ *  \brief Implementation of the stage latency histograms
+ */
+
+#include <iomanip>
+
+#include <time.h>
+
+#include "Profiler.h"
+
+using namespace std;
+
+uint64_t Profiler::Scope::Stop(void)
+{
+    if (!running)
+	return 0;
+    running = false;
+    uint64_t ns = Now() - begin;
+    profiler.Add(stage, ns);
+    return ns;
+}
+
+Profiler::Stage::Stage(const string &n) :
+    name(n), count(0), total(0), max(0), sampling(1), bins(numBins, 0)
+{
+}
+
+/*! Latency below which the given fraction of the calls lie, taken at the
+ *  middle of the bin holding it
+ */
+double Profiler::Stage::Percentile(double fraction) const
+{
+    if (count == 0)
+	return 0;
+
+    uint64_t rank = (uint64_t)(fraction * count);
+    if (rank >= count)
+	rank = count - 1;
+
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < numBins; i++) {
+	sum += bins[i];
+	if (sum > rank) {
+	    double mid = 0.5 * (BinLow(i) + BinLow(i + 1));
+	    return mid < max ? mid : max;
+	}
+    }
+    return max;
+}
+
+/*! Create the stages of the scan itself */
+Profiler::Profiler()
+{
+    const char *names[NUM_STAGES] = {"decode", "sort", "build", "calibrate",
+				     "process", "plot (sampled)", "trace",
+				     "timing", "spill"};
+    for (unsigned i = 0; i < NUM_STAGES; i++)
+	stages.push_back(Stage(names[i]));
+    stages[PLOT].sampling = plotSampling;
+}
+
+/*! Add a stage, e.g. for an event processor, and return its index */
+unsigned Profiler::Register(const string &name)
+{
+    stages.push_back(Stage(name));
+    return stages.size() - 1;
+}
+
+void Profiler::Add(unsigned stage, uint64_t ns)
+{
+    Stage &s = stages[stage];
+    s.count++;
+    s.total += ns;
+    if (ns > s.max)
+	s.max = ns;
+    s.bins[Bin(ns)]++;
+}
+
+/*! Print the statistics of all stages which were called, times in us. The
+ *  calls and total of a sampled stage are estimated for all its calls.
+ */
+void Profiler::Report(ostream &out) const
+{
+    ios_base::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+
+    out << "Profile (us):" << endl
+	<< setw(24) << left << "stage" << right
+	<< setw(12) << "calls" << setw(12) << "total(s)"
+	<< setw(10) << "mean" << setw(10) << "p50"
+	<< setw(10) << "p90" << setw(10) << "p99"
+	<< setw(12) << "max" << endl;
+    out << fixed << setprecision(2);
+    for (vector<Stage>::const_iterator it = stages.begin();
+	 it != stages.end(); it++) {
+	if (it->count == 0)
+	    continue;
+	out << setw(24) << left << it->name << right
+	    << setw(12) << it->count * it->sampling
+	    << setw(12) << it->total * it->sampling * 1e-9
+	    << setw(10) << 1e-3 * it->total / it->count
+	    << setw(10) << 1e-3 * it->Percentile(0.50)
+	    << setw(10) << 1e-3 * it->Percentile(0.90)
+	    << setw(10) << 1e-3 * it->Percentile(0.99)
+	    << setw(12) << 1e-3 * it->max << endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void Profiler::Reset(void)
+{
+    for (vector<Stage>::iterator it = stages.begin(); it != stages.end();
+	 it++) {
+	unsigned sampling = it->sampling;
+	*it = Stage(it->name);
+	it->sampling = sampling;
+    }
+}
+
+uint64_t Profiler::Now(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*! Bins 0-3 hold 0-3 ns, above that each power of two is split in four */
+unsigned Profiler::Bin(uint64_t ns)
+{
+    if (ns < 4)
+	return ns;
+    unsigned e = 63 - __builtin_clzll(ns);
+    unsigned bin = 4 * (e - 1) + ((ns >> (e - 2)) & 3);
+    return bin < numBins ? bin : numBins - 1;
+}
+
+/*! Lower edge of a bin in ns */
+uint64_t Profiler::BinLow(unsigned bin)
+{
+    if (bin < 4)
+	return bin;
+    unsigned e = bin / 4 + 1;
+    return (uint64_t)(4 + bin % 4) << (e - 2);
+}
@@ -42,6 +42,10 @@ namespace dammIds {
         const int DD_POS_ION = OFFSET+20;
         const int DD_SEPAR_GATED_ION = OFFSET+21;
         const int DD_DESI_GATED_ION = OFFSET+22;
+
+        const int D_CORR_CONDITION = OFFSET+30;
+        const int D_CORR_DECAY_TIME = OFFSET+31;
+        const int DD_CORR_DECAY_POS = OFFSET+32;
     }
 }
 
@@ -65,14 +69,23 @@ void PspmtProcessor::DeclarePlots(void) {
     DeclareHistogram2D(DD_POS_ION, SB, SB, "Ion-scint positions - ungated");
     DeclareHistogram2D(DD_SEPAR_GATED_ION, SB, SB, "Ion-scint positions - separator-gated");
     DeclareHistogram2D(DD_DESI_GATED_ION, SB, SB, "Ion-scint positions - silicon dE-gated");
+
+    DeclareHistogram1D(D_CORR_CONDITION, S7, "YSO pixel correlator condition");
+    DeclareHistogram1D(D_CORR_DECAY_TIME, S9, "YSO implant-decay time, 10 ms/bin");
+    DeclareHistogram2D(DD_CORR_DECAY_POS, SB, SB, "YSO correlated decay positions");
 }
 
 const string PspmtProcessor::defaultConfigFile="pspmtConfig.txt";
 
-PspmtProcessor::PspmtProcessor() : EventProcessor()
+// 256x256 pixels over the 2048 channels of the position spectra, decays
+// are also correlated with implants in the adjacent pixels
+PspmtProcessor::PspmtProcessor() : EventProcessor(),
+    pixels(256, 256, 2048., 2048., 1)
 {
     name = "pspmt";
     associatedTypes.insert("pspmt");
+    priority = PRIORITY_LOW; // imaging only
+    cost = COST_HIGH;
 }
 
 bool PspmtProcessor::Init(DetectorDriver &driver, const string &ConfigFile)
@@ -360,6 +373,27 @@ bool PspmtProcessor::Process(RawEvent &event) {
         }
     }
 
+    //implants are upstream-gated low-gain positions, decays are high-gain
+    //positions with nothing upstream
+    Correlator::EConditions condition = Correlator::OTHER_EVENT;
+    if (hasPosition_low && (hasUpstream || hasDeSi) && !lowDynode.empty()) {
+        condition = pixels.Correlate(Correlator::IMPLANT_EVENT,
+                                     position_low.first * positionScale_ + positionOffset_,
+                                     position_low.second * positionScale_ + positionOffset_,
+                                     lowDynode.front()->GetTime());
+    } else if (hasPosition_high && !hasUpstream && !hasDeSi && !hasVeto &&
+               !hiDynode.empty()) {
+        double x = position_high.first * positionScale_ + positionOffset_;
+        double y = position_high.second * positionScale_ + positionOffset_;
+        condition = pixels.Correlate(Correlator::DECAY_EVENT, x, y,
+                                     hiDynode.front()->GetTime());
+        if (condition == Correlator::VALID_DECAY) {
+            plot(D_CORR_DECAY_TIME, pixels.GetDecayTime() * pixie::clockInSeconds / 10e-3);
+            plot(DD_CORR_DECAY_POS, x, y);
+        }
+    }
+    plot(D_CORR_CONDITION, condition);
+
     if(hasUpstream)
         plot(D_TRANS_EFF_YSO, 0);
     if(hasUpstream && hasPosition_ion)
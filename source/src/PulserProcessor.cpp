@@ -27,6 +27,7 @@ PulserProcessor::PulserProcessor(): EventProcessor()
 {
     name = "Pulser";
     associatedTypes.insert("pulser"); //associate with pulser
+    priority = PRIORITY_LOW; // diagnostics
 }
 
 void PulserProcessor::DeclarePlots(void) const
@@ -152,5 +153,5 @@ PulserProcessor::PulserData::PulserData(ChanEvent* chan)
     aveBaseline    = chan->GetAveBaseline();
     highResTime    = chan->GetPhase() + chan->GetTime();
     maxPos         = chan->GetMaxPos();
-    trace          = chan->GetTraceRef();
+    trace.assign(chan->GetTraceRef().begin(), chan->GetTraceRef().end());
 }
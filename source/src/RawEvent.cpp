@@ -55,6 +55,7 @@ void ChanEvent::ZeroNums()
     energy      = -1;
     calEnergy   = -1;
     time        = -1;
+    highResTime = -1;
     calTime     = -1;
     trigTime    = -1;
     eventTimeLo = -1;
@@ -62,8 +63,29 @@ void ChanEvent::ZeroNums()
     runTime0    = -1;
     runTime1    = -1;
     runTime2    = -1;
+    cfdTime     = 0;
+    cfdValidBit = false;
+    pileupBit   = false;
+    saturatedBit = false;
+    pileup      = NO_PILEUP;
     chanNum     = -1;
     modNum      = -1;
+    traceDone   = 0;
+    features.Zero();
+}
+
+/**
+ * Trace features zeroing, all values are set to -1 and no sample is
+ * saturated
+ */
+void TraceFeatures::Zero()
+{
+    baseline       = -1;
+    stdDevBaseline = -1;
+    maxValue       = -1;
+    maxPos         = -1;
+    qdc            = -1;
+    saturated      = 0;
 }
 
 //* Find the identifier in the map for the channel event */
@@ -82,6 +104,14 @@ double ChanEvent::GetTraceInfo(unsigned int a) const
     return ((a >= traceInfo.size()) ? -1 : (traceInfo[a]));
 }
 
+//* Store information about the trace, unset values stay at -1 */
+void ChanEvent::SetTraceInfo(unsigned int a, double b)
+{
+    if (a >= traceInfo.size())
+	traceInfo.resize(a + 1, -1);
+    traceInfo[a] = b;
+}
+
 //* Calculate a channel index */
 int ChanEvent::GetID() const 
 {
@@ -40,161 +40,441 @@
  *----------------------------------------------------------------------*/
 
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
 
+#include <cstdlib>
+
 #include <cmath>
 
 // data related to pixie packet structure
 #include "pixie16app_defs.h"
+#include "Logger.h"
+#include "PixieHeader.h"
 
 // our event structure
 #include "param.h"
 #include "RawEvent.h"
+#include "StatsData.h"
+#include "Telemetry.h"
 
 using pixie::word_t;
 using pixie::halfword_t;
-using std::cout;
-using std::endl;
 
-extern StatsData stats;
+namespace {
+#if defined(REVF)
+    pixie::EFirmware defaultFirmware = pixie::FIRMWARE_REVF;
+#elif defined(REVD)
+    pixie::EFirmware defaultFirmware = pixie::FIRMWARE_REVD;
+#else
+    pixie::EFirmware defaultFirmware = pixie::FIRMWARE_REVA;
+#endif
+    /// firmware of the modules which differ from the default one
+    std::vector<int> moduleFirmware;
+    /// resynchronize on corrupt data instead of giving up the buffer
+    bool resyncMode = true;
+}
 
-// define tst bit function from pixie16 files
-unsigned long TstBit(unsigned short bit, unsigned long value)
+/*! Set the firmware revision of a module, for crates mixing revisions */
+void readbuff::SetFirmware(unsigned modNum, pixie::EFirmware firmware)
 {
-  return ((value & (unsigned long)(pow(2.0, (double)bit))) >> bit);
+    if (modNum >= moduleFirmware.size())
+	moduleFirmware.resize(modNum + 1, -1);
+    moduleFirmware[modNum] = firmware;
 }
 
-/*!
-  \brief extract channel information from raw data
-  
-  ReadBuffData extracts channel information from the raw data arrays
-  and places it into a structure called evt.  A pointer to each
-  of the evt objects is placed in the eventlist vector for later time
-  sorting.
-*/
-int ReadBuffData(word_t *buf, unsigned long *bufLen,
-		 vector<ChanEvent*> &eventList)
-{						
-  // multiplier for high bits of 48-bit time
-  static const double HIGH_MULT = pow(2., 32.); 
+/*! Set the firmware revision of the modules not set individually,
+ *  revision F if compiled with REVF, D with REVD and A otherwise
+ */
+void readbuff::SetDefaultFirmware(pixie::EFirmware firmware)
+{
+    defaultFirmware = firmware;
+}
 
-  word_t modNum;
+pixie::EFirmware readbuff::GetDefaultFirmware(void)
+{
+    return defaultFirmware;
+}
 
-  unsigned long numEvents = 0;
-  word_t *bufStart = buf;
+pixie::EFirmware readbuff::GetFirmware(unsigned modNum)
+{
+    if (modNum < moduleFirmware.size() && moduleFirmware[modNum] >= 0)
+	return (pixie::EFirmware)moduleFirmware[modNum];
+    return defaultFirmware;
+}
 
-  /* Determine the number of words in the buffer */
-  *bufLen = *buf++;
+/*! Set the firmware revisions from a list separated by commas of a, d or f
+ *  for the default revision and module:revision for single modules, e.g.
+ *  "d,4:f,5:f" as given in PIXIE_FIRMWARE. Nothing is changed and false is
+ *  returned if the list can not be read.
+ */
+bool readbuff::SetFirmwares(const std::string &spec)
+{
+    pixie::EFirmware firmware;
+    bool hasDefault = false;
+    pixie::EFirmware newDefault = defaultFirmware;
+    std::vector< std::pair<unsigned, pixie::EFirmware> > modules;
 
-  /* Read the module number */
-  modNum = *buf++;
+    std::istringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+	size_t colon = item.find(':');
+	if (colon == std::string::npos) {
+	    if (!ParseFirmware(item, firmware))
+		return false;
+	    hasDefault = true;
+	    newDefault = firmware;
+	    continue;
+	}
+	std::string mod = item.substr(0, colon);
+	char *end;
+	unsigned long modNum = strtoul(mod.c_str(), &end, 10);
+	if (mod.empty() || *end != '\0' || modNum > 255 ||
+	    !ParseFirmware(item.substr(colon + 1), firmware))
+	    return false;
+	modules.push_back(std::make_pair(unsigned(modNum), firmware));
+    }
+    if (!hasDefault && modules.empty())
+	return false;
+
+    defaultFirmware = newDefault;
+    for (size_t i = 0; i < modules.size(); i++)
+	SetFirmware(modules[i].first, modules[i].second);
+    return true;
+}
 
-  if( *bufLen > 0 ) { // check if the buffer has data
-    if (*bufLen == 2) {
-      // this is an empty channel
-      return 0;
+/*! Set firmware from its name (a, d or f), false if it is unknown */
+bool readbuff::ParseFirmware(const std::string &name,
+			     pixie::EFirmware &firmware)
+{
+    if (name == "a" || name == "A")
+	firmware = pixie::FIRMWARE_REVA;
+    else if (name == "d" || name == "D")
+	firmware = pixie::FIRMWARE_REVD;
+    else if (name == "f" || name == "F")
+	firmware = pixie::FIRMWARE_REVF;
+    else
+	return false;
+    return true;
+}
+
+const char* readbuff::GetFirmwareName(pixie::EFirmware firmware)
+{
+    switch (firmware) {
+    case pixie::FIRMWARE_REVA: return "Rev. A";
+    case pixie::FIRMWARE_REVD: return "Rev. D";
+    case pixie::FIRMWARE_REVF: return "Rev. F";
     }
-    do {
-        ChanEvent *currentEvt = new ChanEvent;
-        // decoding event data... see pixie16app.c
-        // buf points to the start of channel data
-
-        //Decode the first header word
-        word_t chanNum = (buf[0] & 0x0000000F);
-        word_t slotNum = (buf[0] & 0x000000F0) >> 4;
-        word_t crateNum = (buf[0] & 0x00000F00) >> 8;
-        word_t headerLength = (buf[0] & 0x0001F000) >> 12;
-        word_t eventLength = (buf[0] & 0x7FFE0000) >> 17;
-        word_t finishCode = (buf[0] & 0x80000000) != 0;
-
-        // Sanity check
-        if (headerLength == stats.headerLength) {
-            // this is a manual statistics block inserted poll
-            stats.DoStatisticsBlock(&buf[1], modNum);
-            buf += eventLength;
-            numEvents = readbuff::STATS;
-            continue;
-        }
-
-        //Decode the second header word
-        word_t lowTime = buf[1];
-
-        //Decode the third header word
-        word_t highTime = buf[2] & 0x0000FFFF;
-        word_t cfdTime = (buf[2] & 0x3FFF0000) >> 16;
-        word_t cfdTrigSource = ((buf[2] & 0x40000000) != 0);
-        word_t cfdForceTrig = ((buf[2] & 0x80000000) != 0);
-
-        //Decode the foruth header word
-        word_t energy = buf[3] & 0x00007FFF;
-        word_t traceLength = (buf[3] & 0xFFFF0000) >> 16;
-        word_t saturatedBit = ((buf[3] & 0x00008000) >> 15 != 0);
-
-      // Rev. D header lengths not clearly defined in pixie16app_defs
-      //! magic numbers here for now
-      // make some sanity checks
-      if (headerLength == stats.headerLength) {
-	// this is a manual statistics block inserted by the poll program
+    return "unknown";
+}
+
+/*! With resync set (the default) a header which can not be followed makes
+ *  the decoder skip to the next plausible channel header of the buffer, and
+ *  the spill skip to the next valid module record, keeping the rest of the
+ *  data. Without it the buffer is given up with readbuff::ERROR and the
+ *  spill thrown away as in the original scan.
+ */
+void readbuff::SetResync(bool resync)
+{
+    resyncMode = resync;
+}
+
+bool readbuff::GetResync(void)
+{
+    return resyncMode;
+}
+
+/*!
+  \brief decoder of the channels of a module buffer for a header layout
+
+  The buffer is decoded in two passes. The first one only follows the
+  length fields from header to header, checks them and records where each
+  channel starts; this walk is serial since each position depends on the
+  previous header. The second pass decodes the indexed channels, which are
+  independent of each other, extracting all fields from the first four
+  header words with the fixed shifts and masks of the layout.
+*/
+template<class Layout>
+class BufferDecoder {
+ public:
+    static int Index(word_t *buf, word_t *bufEnd, word_t modNum,
+		     unsigned long bufLen, vector<const word_t*> &hits);
+    static ChanEvent* DecodeHit(const word_t *hit, word_t modNum);
+
+ private:
+    static bool Plausible(const word_t *buf, const word_t *bufEnd);
+    static word_t* Resync(word_t *buf, word_t *bufEnd, const word_t *expected);
+};
+
+/*!
+  Fill hits with the start of each valid channel of the buffer. Statistics
+  blocks are handed to the StatsData on the way. A header which can not be
+  followed is skipped up to the next plausible one in resync mode, see
+  readbuff::SetResync(). Returns readbuff::STATS if the buffer held a
+  statistics block, readbuff::ERROR if a header can not be followed outside
+  of resync mode and 0 otherwise.
+*/
+template<class Layout>
+int BufferDecoder<Layout>::Index(word_t *buf, word_t *bufEnd, word_t modNum,
+				 unsigned long bufLen,
+				 vector<const word_t*> &hits)
+{
+  int retval = 0;
+  size_t firstHit = hits.size();
+
+  while (buf < bufEnd) {
+    word_t headerLength = Layout::HeaderLength::Get(buf);
+    word_t eventLength  = Layout::EventLength::Get(buf);
+    word_t traceLength  = Layout::TraceLength::Get(buf);
+
+    bool inBuffer = (buf + eventLength <= bufEnd);
+    if (headerLength == stats.headerLength) {
+      // this is a manual statistics block inserted by the poll program
+      if (eventLength >= 1 + StatsData::statSize && inBuffer) {
 	stats.DoStatisticsBlock(&buf[1], modNum);
 	buf += eventLength;
-	numEvents = readbuff::STATS;
+	retval = readbuff::STATS;
 	continue;
       }
-      if (headerLength != 4) {
-	cout << "  Unexpected header length: " << headerLength << endl;
-	cout << "    Buffer " << modNum << " of length " << *bufLen << endl;
-	cout << "    CHAN:SLOT:CRATE " 
-	     << chanNum << ":" << slotNum << ":" << crateNum << endl;
-	// advance to next event and continue
-	// buf += EventLength;
-	// continue;
-
-	// skip the rest of this buffer
-	//return numEvents;
-    return readbuff::ERROR;
-      }
-
-      // one last sanity check
-      if ( traceLength / 2 + headerLength != eventLength ) {
-	cout << "  Bad event length (" << eventLength
-	     << ") does not correspond with length of header (" << headerLength
-	     << ") and length of trace (" << traceLength << ")" << endl;
+      PIXIE_LOG(ERROR, "ReadBuffData: bad statistics block",
+		"Statistics block of length " << eventLength << " in buffer "
+		<< modNum << " of length " << bufLen);
+    } else {
+      bool validHeader = Layout::ValidHeader(headerLength);
+      bool validLength = (traceLength / 2 + headerLength == eventLength);
+      if (validHeader & validLength & inBuffer) {
+	hits.push_back(buf);
 	buf += eventLength;
 	continue;
       }
-
-      // handle multiple crates
-      modNum += 100 * crateNum;
-
-      currentEvt->chanNum = chanNum;
-      currentEvt->modNum = modNum;
-      currentEvt->energy = energy;
-      currentEvt->trigTime = cfdTime;
-      currentEvt->eventTimeHi = highTime;
-      currentEvt->eventTimeLo = lowTime;
-      currentEvt->time = highTime * HIGH_MULT + lowTime;
-
-      buf += headerLength;
-      /* Check if trace data follows the channel header */
-      if ( traceLength > 0 ) {
-	// sbuf points to the beginning of trace data
-	halfword_t *sbuf = (halfword_t *)buf; 
-	// Read the trace data (2-bytes per sample, i.e. 2 samples per word)
-	for(unsigned int k = 0; k < traceLength; k ++) {
-	  currentEvt->trace.push_back(sbuf[k]);
+      if (!validHeader) {
+	PIXIE_LOG(ERROR, "ReadBuffData: unexpected header length",
+		  "Unexpected header length " << headerLength << " in buffer "
+		  << modNum << " of length " << bufLen << ", CHAN:SLOT:CRATE "
+		  << Layout::Chan::Get(buf) << ":" << Layout::Slot::Get(buf)
+		  << ":" << Layout::Crate::Get(buf));
+      } else if (!inBuffer) {
+	PIXIE_LOG(ERROR, "ReadBuffData: event past the end of the buffer",
+		  "Event length (" << eventLength
+		  << ") runs past the end of buffer " << modNum);
+      } else {
+	PIXIE_LOG(WARNING, "ReadBuffData: bad event length",
+		  "Bad event length (" << eventLength
+		  << ") does not correspond with length of header ("
+		  << headerLength << ") and length of trace (" << traceLength
+		  << ")");
+	if (eventLength > 0) {
+	  telemetry.Count(Telemetry::DROPPED_WORDS, eventLength);
+	  buf += eventLength;
+	  continue;
 	}
-	buf += traceLength / 2;
       }
-      eventList.push_back(currentEvt);
-
-      numEvents++;
-    } while ( buf < bufStart + *bufLen );
-  } else {// if buffer has data
-    cout << "ERROR BufNData " << *bufLen << endl;
-    cout << "ERROR IN ReadBuffData" << endl;
-    cout << "LIST UNKNOWN" << endl;
+    }
+
+    if (!readbuff::GetResync()) {
+      // skip the rest of this buffer
+      return readbuff::ERROR;
+    }
+    // the channels of the buffer so far tell the slot to look for
+    const word_t *expected = (hits.size() > firstHit) ? hits[firstHit] : NULL;
+    word_t *next = Resync(buf, bufEnd, expected);
+    PIXIE_LOG(WARNING, "ReadBuffData: resynchronized",
+	      "Skipped " << (next - buf) << " words of buffer " << modNum
+	      << " to " << ((next < bufEnd) ? "the next channel header"
+			    : "its end"));
+    telemetry.Count(Telemetry::RESYNCS);
+    telemetry.Count(Telemetry::DROPPED_WORDS, next - buf);
+    buf = next;
+  }
+
+  return retval;
+}
+
+/*! A channel header at buf whose lengths agree and which ends in the
+ *  buffer */
+template<class Layout>
+bool BufferDecoder<Layout>::Plausible(const word_t *buf, const word_t *bufEnd)
+{
+  if (buf + Layout::minHeaderLength > bufEnd)
+    return false;
+  word_t headerLength = Layout::HeaderLength::Get(buf);
+  word_t eventLength  = Layout::EventLength::Get(buf);
+  word_t traceLength  = Layout::TraceLength::Get(buf);
+  return Layout::ValidHeader(headerLength) &&
+    traceLength / 2 + headerLength == eventLength &&
+    buf + eventLength <= bufEnd;
+}
+
+/*! Find the first plausible channel header after buf, bufEnd if there is
+ *  none. A candidate must be followed by another plausible header or the
+ *  end of the buffer and, if an expected channel of the buffer is given,
+ *  come from the same slot and crate, so that trace samples or energies
+ *  looking like a header are not taken for one.
+ */
+template<class Layout>
+word_t* BufferDecoder<Layout>::Resync(word_t *buf, word_t *bufEnd,
+				      const word_t *expected)
+{
+  for (word_t *next = buf + 1; next < bufEnd; next++) {
+    if (!Plausible(next, bufEnd))
+      continue;
+    if (expected != NULL &&
+	(Layout::Slot::Get(next) != Layout::Slot::Get(expected) ||
+	 Layout::Crate::Get(next) != Layout::Crate::Get(expected)))
+      continue;
+    const word_t *after = next + Layout::EventLength::Get(next);
+    if (after == bufEnd || Plausible(after, bufEnd))
+      return next;
+  }
+  return bufEnd;
+}
+
+/*! Decode one channel indexed by Index() */
+template<class Layout>
+ChanEvent* BufferDecoder<Layout>::DecodeHit(const word_t *hit, word_t modNum)
+{
+  // multiplier for high bits of 48-bit time
+  static const double HIGH_MULT = 4294967296.;
+
+  const word_t header[4] = {hit[0], hit[1], hit[2], hit[3]};
+
+  word_t lowTime  = Layout::TimeLow::Get(header);
+  word_t highTime = Layout::TimeHigh::Get(header);
+  word_t cfdTime  = Layout::Cfd::Get(header);
+  word_t traceLength = Layout::TraceLength::Get(header);
+
+  ChanEvent *currentEvt = new ChanEvent;
+  currentEvt->chanNum = Layout::Chan::Get(header);
+  // handle multiple crates
+  currentEvt->modNum = modNum + 100 * Layout::Crate::Get(header);
+  currentEvt->energy = Layout::Energy::Get(header);
+  currentEvt->pileupBit = (Layout::Pileup::Get(header) != 0);
+  currentEvt->saturatedBit = (Layout::Saturated::Get(header) != 0);
+  if (Layout::cfdTrigTime) {
+    currentEvt->trigTime = cfdTime;
+  } else {
+    currentEvt->trigTime = lowTime;
+    // a forced CFD trigger carries no fraction
+    currentEvt->cfdValidBit = (Layout::CfdForced::Get(header) == 0);
+    currentEvt->cfdTime = currentEvt->cfdValidBit ? cfdTime : 0;
+  }
+  currentEvt->eventTimeHi = highTime;
+  currentEvt->eventTimeLo = lowTime;
+  currentEvt->time = highTime * HIGH_MULT + lowTime;
+
+  /* Check if trace data follows the channel header */
+  if ( traceLength > 0 ) {
+    // the samples stay in the buffer (2-bytes per sample, i.e. 2 samples
+    // per word) which outlives the processing of the spill
+    const word_t *trace = hit + Layout::HeaderLength::Get(header);
+    currentEvt->trace = TraceView((const halfword_t *)trace, traceLength);
+  }
+  return currentEvt;
+}
+
+/*!
+  Index the channels of a module buffer: on return hits holds the start of
+  each valid channel and modNum the module of the buffer. Returns the
+  number of channels, readbuff::STATS for a buffer with only a statistics
+  block and readbuff::ERROR if the buffer can not be read.
+*/
+int readbuff::IndexBuffData(word_t *buf, unsigned long *bufLen,
+			    word_t &modNum, vector<const word_t*> &hits)
+{
+  word_t *bufStart = buf;
+
+  /* Determine the number of words in the buffer */
+  *bufLen = *buf++;
+
+  /* Read the module number */
+  modNum = *buf++;
+
+  if ( *bufLen == 0 ) {
+    PIXIE_LOG(ERROR, "ReadBuffData: empty buffer",
+	      "Buffer of module " << modNum << " has no length, list unknown");
     return readbuff::ERROR;
   }
+  if (*bufLen == 2) {
+    // this is an empty channel
+    return 0;
+  }
+
+  size_t firstHit = hits.size();
+  word_t *bufEnd = bufStart + *bufLen;
+  int retval;
+  switch (readbuff::GetFirmware(modNum)) {
+  case pixie::FIRMWARE_REVA:
+    retval = BufferDecoder<pixie::RevALayout>::Index(buf, bufEnd, modNum,
+						      *bufLen, hits);
+    break;
+  case pixie::FIRMWARE_REVF:
+    retval = BufferDecoder<pixie::RevFLayout>::Index(buf, bufEnd, modNum,
+						      *bufLen, hits);
+    break;
+  case pixie::FIRMWARE_REVD:
+  default:
+    retval = BufferDecoder<pixie::RevDLayout>::Index(buf, bufEnd, modNum,
+						      *bufLen, hits);
+    break;
+  }
+  // a buffer holding channels besides its statistics block counts them
+  size_t numHits = hits.size() - firstHit;
+  if (retval == readbuff::ERROR || numHits == 0)
+    return retval;
+  return numHits;
+}
+
+/*!
+  Decode numHits channels of module modNum indexed by IndexBuffData() into
+  events. Only reads the buffer, so distinct ranges of hits can be decoded
+  concurrently.
+*/
+void readbuff::DecodeHits(const word_t *const *hits, size_t numHits,
+			  word_t modNum, ChanEvent **events)
+{
+  switch (readbuff::GetFirmware(modNum)) {
+  case pixie::FIRMWARE_REVA:
+    for (size_t i = 0; i < numHits; i++)
+      events[i] = BufferDecoder<pixie::RevALayout>::DecodeHit(hits[i], modNum);
+    break;
+  case pixie::FIRMWARE_REVF:
+    for (size_t i = 0; i < numHits; i++)
+      events[i] = BufferDecoder<pixie::RevFLayout>::DecodeHit(hits[i], modNum);
+    break;
+  case pixie::FIRMWARE_REVD:
+  default:
+    for (size_t i = 0; i < numHits; i++)
+      events[i] = BufferDecoder<pixie::RevDLayout>::DecodeHit(hits[i], modNum);
+    break;
+  }
+}
+
+/*!
+  \brief extract channel information from raw data
   
-  return numEvents;
+  ReadBuffData extracts channel information from the raw data arrays
+  and places it into a structure called evt.  A pointer to each
+  of the evt objects is placed in the eventlist vector for later time
+  sorting. The buffer is decoded with the header layout of the firmware
+  of its module, see readbuff::SetFirmwares() and PIXIE_FIRMWARE.
+*/
+int ReadBuffData(word_t *buf, unsigned long *bufLen,
+		 vector<ChanEvent*> &eventList)
+{
+  // reused from buffer to buffer
+  static vector<const word_t*> hits;
+
+  word_t modNum;
+  hits.clear();
+  int retval = readbuff::IndexBuffData(buf, bufLen, modNum, hits);
+  if (retval == readbuff::ERROR)
+    return retval;
+
+  size_t first = eventList.size();
+  eventList.resize(first + hits.size());
+  if (!hits.empty())
+    readbuff::DecodeHits(&hits[0], hits.size(), modNum, &eventList[first]);
+
+  return retval;
 }
@@ -0,0 +1,151 @@
+/*! \file SpillBench.cpp
+ *
+ * Benchmark of the scan on synthetic spills. The spills from the
+ * SpillGenerator are handed to hissub_sec() as the poll program would, so
+ * that decoding, timing, sorting, event building and processing all run as
+ * online. The detector setup is read from map.txt and cal.txt in the
+ * current directory, the channels of map.txt are the ones which fire.
+ *
+ * Usage: pixie_bench [-s spills] [-r rate] [-l spill length (s)]
+ *                    [-m multiplicity] [-t trace length] [-x stats interval]
+ *                    [-j decoding threads] [-S seed]
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include "param.h"
+#include "pixie16app_defs.h"
+#include "Profiler.h"
+#include "SpillDecoder.h"
+#include "SpillGenerator.h"
+
+using namespace std;
+using pixie::word_t;
+
+void hissub_sec(word_t *ibuf[], unsigned int *nhw);
+extern "C" void drrsub_(unsigned int &iexist);
+extern SpillDecoder spillDecoder;
+
+/** Fill the config with the channels of map.txt, false if it can't be read */
+static bool ReadChannels(SpillGenerator::Config &config)
+{
+    ifstream mapFile("map.txt");
+    if (!mapFile.good())
+	return false;
+
+    config.channels.clear();
+    config.numModules = 0;
+    string line;
+    while (getline(mapFile, line)) {
+	if (line.empty() || line[0] == '%' || line[0] == '#')
+	    continue;
+	istringstream fields(line);
+	unsigned mod, chan;
+	string damm, type;
+	if (!(fields >> mod >> chan >> damm >> type) || type == "ignore")
+	    continue;
+	config.channels.push_back(mod * NUMBER_OF_CHANNELS + chan);
+	if (mod + 1 > config.numModules)
+	    config.numModules = mod + 1;
+    }
+    return !config.channels.empty();
+}
+
+int main(int argc, char **argv)
+{
+    SpillGenerator::Config config;
+    unsigned numSpills = 200;
+    int threads = -1;
+
+    if (!ReadChannels(config)) {
+	cout << "Can not read the channels from 'map.txt'" << endl;
+	return EXIT_FAILURE;
+    }
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:l:m:t:x:j:S:")) != -1) {
+	switch (opt) {
+	case 's': numSpills = atoi(optarg); break;
+	case 'r': config.rate = atof(optarg); break;
+	case 'l': config.spillLength = atof(optarg); break;
+	case 'm': config.multiplicity = atoi(optarg); break;
+	case 't': config.traceLength = atoi(optarg); break;
+	case 'x': config.statsInterval = atoi(optarg); break;
+	case 'j': threads = atoi(optarg); break;
+	case 'S': config.seed = atoi(optarg); break;
+	default:
+	    cout << "Usage: " << argv[0] << " [-s spills] [-r rate] "
+		 << "[-l spill length (s)] [-m multiplicity] [-t trace length] "
+		 << "[-x stats interval] [-j decoding threads] [-S seed]" << endl;
+	    return EXIT_FAILURE;
+	}
+    }
+    if (threads >= 0)
+	spillDecoder.SetThreads(threads);
+
+    unsigned int iexist = 0;
+    drrsub_(iexist);
+
+    SpillGenerator generator(config);
+    vector<word_t> spill;
+    size_t numHits = 0;
+
+    // the first spill initializes the analysis, it is not timed
+    generator.Generate(spill);
+    word_t *ibuf = &spill[0];
+    unsigned int nhw = 2 * spill.size();
+    hissub_sec(&ibuf, &nhw);
+    profiler.Reset();
+
+    // the generation of the spills is left out of the total
+    uint64_t scanTime = 0;
+    for (unsigned i = 0; i < numSpills; i++) {
+	generator.Generate(spill);
+	numHits += generator.GetNumHits();
+	ibuf = &spill[0];
+	nhw = 2 * spill.size();
+	uint64_t begin = Profiler::Now();
+	hissub_sec(&ibuf, &nhw);
+	scanTime += Profiler::Now() - begin;
+    }
+    double total = 1e-9 * scanTime;
+
+    cout << endl << numSpills << " spills, " << numHits << " hits, "
+	 << config.numModules << " modules, " << config.channels.size()
+	 << " channels, multiplicity " << config.multiplicity << ", trace "
+	 << config.traceLength << ", " << spillDecoder.GetThreads()
+	 << " decoding threads" << endl;
+
+    const Profiler::EStage stages[] = {Profiler::DECODE, Profiler::TIMING,
+				       Profiler::SORT, Profiler::BUILD,
+				       Profiler::PROCESS};
+    ios_base::fmtflags flags = cout.flags();
+    cout << setw(12) << left << "stage" << right << setw(12) << "total(s)"
+	 << setw(12) << "ns/hit" << setw(14) << "hits/s" << endl;
+    cout << fixed << setprecision(3);
+    for (unsigned i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+	double t = profiler.GetTotal(stages[i]);
+	cout << setw(12) << left << profiler.GetName(stages[i]) << right
+	     << setw(12) << t
+	     << setw(12) << (numHits > 0 ? 1e9 * t / numHits : 0.)
+	     << setw(14) << setprecision(0) << (t > 0 ? numHits / t : 0.)
+	     << setprecision(3) << endl;
+    }
+    cout << setw(12) << left << "all" << right << setw(12) << total
+	 << setw(12) << (numHits > 0 ? 1e9 * total / numHits : 0.)
+	 << setw(14) << setprecision(0) << (total > 0 ? numHits / total : 0.)
+	 << endl;
+    cout.flags(flags);
+
+    profiler.Report(cout);
+
+    return EXIT_SUCCESS;
+}
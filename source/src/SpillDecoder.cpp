@@ -0,0 +1,139 @@
+/** \file SpillDecoder.cpp
+ *  \brief Implementation of the threaded spill decoding
+ */
+
+#include "PixieHeader.h"
+#include "RawEvent.h"
+#include "SpillDecoder.h"
+
+using namespace std;
+using pixie::word_t;
+
+/*! One thread per core up to one per module of a full crate, the calling
+ *  thread being one of them
+ */
+SpillDecoder::SpillDecoder() :
+    output(NULL), generation(0), running(0), stop(false), nextModule(0)
+{
+    unsigned n = thread::hardware_concurrency();
+    SetThreads(n < 14 ? n : 14);
+}
+
+SpillDecoder::~SpillDecoder()
+{
+    StopWorkers();
+}
+
+/*! Decode with n threads including the calling one, 1 or 0 decodes
+ *  without any worker thread
+ */
+void SpillDecoder::SetThreads(unsigned n)
+{
+    StopWorkers();
+    for (unsigned i = 1; i < n; i++)
+	workers.push_back(thread(&SpillDecoder::Work, this));
+}
+
+void SpillDecoder::StopWorkers(void)
+{
+    {
+	lock_guard<mutex> lock(poolMutex);
+	stop = true;
+    }
+    wake.notify_all();
+    for (vector<thread>::iterator it = workers.begin();
+	 it != workers.end(); it++)
+	it->join();
+    workers.clear();
+    stop = false;
+}
+
+/*! Index a module buffer of the spill, the return value is the one of
+ *  ReadBuffData(). The buffer must stay in place until Decode().
+ */
+int SpillDecoder::Add(word_t *buf, unsigned long *bufLen)
+{
+    Module module;
+    module.first = hits.size();
+    int retval = readbuff::IndexBuffData(buf, bufLen, module.modNum, hits);
+    if (retval == readbuff::ERROR) {
+	hits.resize(module.first);
+	return retval;
+    }
+    module.size = hits.size() - module.first;
+    if (module.size > 0)
+	modules.push_back(module);
+    return retval;
+}
+
+/*! Decode all the channels added since the last call and append them to
+ *  eventList in the order they were added
+ */
+void SpillDecoder::Decode(vector<ChanEvent*> &eventList)
+{
+    size_t first = eventList.size();
+    eventList.resize(first + hits.size());
+    if (hits.empty()) {
+	Clear();
+	return;
+    }
+    output = &eventList[first];
+    nextModule = 0;
+
+    if (workers.empty() || modules.size() == 1) {
+	DecodeModules();
+    } else {
+	{
+	    lock_guard<mutex> lock(poolMutex);
+	    running = workers.size();
+	    generation++;
+	}
+	wake.notify_all();
+	DecodeModules();
+
+	unique_lock<mutex> lock(poolMutex);
+	while (running > 0)
+	    finished.wait(lock);
+    }
+
+    Clear();
+}
+
+/*! Forget the indexed channels which were not decoded */
+void SpillDecoder::Clear(void)
+{
+    hits.clear();
+    modules.clear();
+    output = NULL;
+}
+
+/*! Take modules not decoded yet until there are none left */
+void SpillDecoder::DecodeModules(void)
+{
+    size_t i;
+    while ((i = nextModule++) < modules.size()) {
+	const Module &module = modules[i];
+	readbuff::DecodeHits(&hits[module.first], module.size,
+			     module.modNum, output + module.first);
+    }
+}
+
+void SpillDecoder::Work(void)
+{
+    unique_lock<mutex> lock(poolMutex);
+    unsigned seen = generation;
+    while (true) {
+	while (!stop && generation == seen)
+	    wake.wait(lock);
+	if (stop)
+	    return;
+	seen = generation;
+
+	lock.unlock();
+	DecodeModules();
+	lock.lock();
+
+	if (--running == 0)
+	    finished.notify_one();
+    }
+}
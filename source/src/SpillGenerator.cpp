@@ -0,0 +1,173 @@
+/** \file SpillGenerator.cpp
+ *  \brief Implementation of the synthetic spills
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "pixie16app_defs.h"
+#include "RawEvent.h"
+#include "SpillGenerator.h"
+#include "StatsData.h"
+
+using namespace std;
+using pixie::word_t;
+
+namespace {
+    /// live time a channel loses per trigger in seconds
+    const double deadTime = 2e-6;
+
+    /// order the hits of a module by time
+    struct EarlierThan {
+	template<class T>
+	bool operator()(const T &a, const T &b) const {return a.time < b.time;}
+    };
+}
+
+/*! A full crate of MTAS-like events without traces */
+SpillGenerator::Config::Config() :
+    numModules(6), rate(20000), spillLength(0.1), multiplicity(4),
+    traceLength(0), statsInterval(10), seed(1)
+{
+    for (unsigned id = 0; id < numModules * NUMBER_OF_CHANNELS; id++)
+	channels.push_back(id);
+}
+
+SpillGenerator::SpillGenerator(const Config &config) :
+    config(config), random(config.seed), clock(0), numHits(0), numSpills(0),
+    moduleHits(config.numModules), moduleStats(config.numModules)
+{
+    for (unsigned mod = 0; mod < config.numModules; mod++)
+	bzero(&moduleStats[mod], sizeof(moduleStats[mod]));
+    // a trace fills whole words
+    this->config.traceLength &= ~1u;
+}
+
+/*! Replace the content of spill by the next spill */
+void SpillGenerator::Generate(vector<word_t> &spill)
+{
+    const double ticksPerSecond = 1. / pixie::clockInSeconds;
+    double spillEnd = clock + config.spillLength * ticksPerSecond;
+
+    hits.clear();
+    while (!config.channels.empty()) {
+	clock -= log(random.randDblExc()) * ticksPerSecond / config.rate;
+	if (clock >= spillEnd)
+	    break;
+	// an exponential spectrum with a tail up to the top of the range
+	unsigned total = 200 + unsigned(-2000 * log(random.randDblExc()));
+	size_t first = hits.size();
+	unsigned multiplicity = min<size_t>(config.multiplicity,
+					    config.channels.size());
+	for (unsigned i = 0; i < multiplicity; i++) {
+	    Hit hit;
+	    hit.time = floor(clock + random.randInt(eventSpread));
+	    // a channel fires once per event
+	    bool fired;
+	    do {
+		hit.id = config.channels[random.randInt(config.channels.size() - 1)];
+		fired = false;
+		for (size_t j = first; j < hits.size(); j++)
+		    fired |= (hits[j].id == hit.id);
+	    } while (fired);
+	    hit.energy = min(total / config.multiplicity + unsigned(random.randInt(50)), 30000u);
+	    hits.push_back(hit);
+	}
+    }
+    clock = spillEnd;
+    numHits = hits.size();
+
+    for (unsigned mod = 0; mod < config.numModules; mod++)
+	moduleHits[mod].clear();
+    for (vector<Hit>::const_iterator it = hits.begin(); it != hits.end(); it++) {
+	unsigned mod = it->id / NUMBER_OF_CHANNELS;
+	if (mod < config.numModules) {
+	    moduleHits[mod].push_back(*it);
+	    // every trigger is written out, and costs the channel its dead time
+	    StatsData::ChannelStats &channel =
+		moduleStats[mod].channel[it->id % NUMBER_OF_CHANNELS];
+	    channel.fastPeaks++;
+	    channel.outputCounts++;
+	    channel.liveTime -= deadTime;
+	}
+    }
+    for (unsigned mod = 0; mod < config.numModules; mod++) {
+	StatsData::ModuleStats &module = moduleStats[mod];
+	double realTime = clock * pixie::clockInSeconds;
+	for (unsigned ch = 0; ch < NUMBER_OF_CHANNELS; ch++)
+	    module.channel[ch].liveTime += realTime - module.realTime;
+	module.realTime = realTime;
+    }
+
+    spill.clear();
+    bool withStats = (config.statsInterval > 0 &&
+		      numSpills % config.statsInterval == 0);
+    for (unsigned mod = 0; mod < config.numModules; mod++) {
+	size_t start = spill.size();
+	spill.push_back(0); // record length, set once known
+	spill.push_back(mod);
+	if (withStats)
+	    WriteStatistics(mod, spill);
+	sort(moduleHits[mod].begin(), moduleHits[mod].end(), EarlierThan());
+	for (vector<Hit>::const_iterator it = moduleHits[mod].begin();
+	     it != moduleHits[mod].end(); it++)
+	    WriteHit(*it, spill);
+	spill[start] = spill.size() - start;
+	spill.push_back(U_DELIMITER);
+    }
+
+    // end of spill, and the padding hissub_sec expects past it
+    spill.push_back(2);
+    spill.push_back(9999);
+    spill.push_back(U_DELIMITER);
+    spill.insert(spill.end(), 8, U_DELIMITER);
+
+    numSpills++;
+}
+
+/*! Write a Rev. D channel header, followed by a trace with a pulse of
+ *  height proportional to the energy if traces are enabled
+ */
+void SpillGenerator::WriteHit(const Hit &hit, vector<word_t> &spill)
+{
+    const word_t headerLength = 4;
+    word_t eventLength = headerLength + config.traceLength / 2;
+    unsigned long long time = (unsigned long long)hit.time;
+    word_t cfd = random.randInt(0x7FFF);
+
+    spill.push_back((hit.id % NUMBER_OF_CHANNELS) |
+		    ((hit.id / NUMBER_OF_CHANNELS + 2) << 4) |
+		    (headerLength << 12) | (eventLength << 17));
+    spill.push_back(word_t(time & 0xFFFFFFFF));
+    spill.push_back(word_t((time >> 32) & 0xFFFF) | (cfd << 16));
+    spill.push_back(hit.energy | (config.traceLength << 16));
+
+    if (config.traceLength == 0)
+	return;
+
+    unsigned start = config.traceLength / pulsePosition;
+    double height = 0.25 * hit.energy;
+    for (unsigned i = 0; i < config.traceLength; i += 2) {
+	word_t samples[2];
+	for (unsigned j = 0; j < 2; j++) {
+	    double value = baseline + random.randNorm(0, 2);
+	    if (i + j >= start) {
+		double t = i + j - start;
+		value += height * (1 - exp(-t / 2.)) * exp(-t / 20.);
+	    }
+	    samples[j] = min(word_t(max(value, 0.)), word_t(4095));
+	}
+	spill.push_back(samples[0] | (samples[1] << 16));
+    }
+}
+
+/*! Write a Rev. D statistics block with the counters of a module */
+void SpillGenerator::WriteStatistics(unsigned mod, vector<word_t> &spill)
+{
+    const word_t statSize = StatsData::statSize;
+    spill.push_back((StatsData::headerLength << 12) | ((statSize + 1) << 17));
+    size_t start = spill.size();
+    spill.resize(start + statSize);
+    StatsData::Encode(moduleStats[mod], pixie::FIRMWARE_REVD, &spill[start]);
+}
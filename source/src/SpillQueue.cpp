@@ -0,0 +1,174 @@
+/** \file SpillQueue.cpp
+ *  \brief Implementation of the live mode spill queue
+ */
+
+#include <cstring>
+
+#include "Profiler.h"
+#include "SpillQueue.h"
+
+using namespace std;
+using pixie::word_t;
+
+SpillQueue::SpillQueue() :
+    policy(BLOCK), capacity(0), consumer(NULL), running(false), stop(false)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+SpillQueue::~SpillQueue()
+{
+    Stop();
+}
+
+/*! Start the analysis thread, spills are then taken by Push(). False if it
+ *  is already running or the capacity is 0.
+ */
+bool SpillQueue::Start(EPolicy policy, size_t capacity, Consumer consumer)
+{
+    if (running || capacity == 0 || consumer == NULL)
+	return false;
+
+    this->policy = policy;
+    this->capacity = capacity;
+    this->consumer = consumer;
+    stop = false;
+    running = true;
+    worker = thread(&SpillQueue::Work, this);
+    return true;
+}
+
+/*! Analyze the spills left in the queue and stop the analysis thread */
+void SpillQueue::Stop(void)
+{
+    if (!running)
+	return;
+    {
+	lock_guard<mutex> lock(queueMutex);
+	stop = true;
+    }
+    notEmpty.notify_one();
+    worker.join();
+    running = false;
+}
+
+/*! Queue a copy of the spill, waiting for room or dropping the oldest spill
+ *  as the policy says. False if a spill was dropped to make room.
+ */
+bool SpillQueue::Push(const word_t *data, size_t nWords)
+{
+    unique_lock<mutex> lock(queueMutex);
+    stats.pushed++;
+
+    bool dropped = false;
+    if (queue.size() >= capacity) {
+	if (policy == DROP_OLDEST) {
+	    stats.dropped++;
+	    stats.droppedWords += queue.front().size();
+	    freeSpills.push_back(vector<word_t>());
+	    freeSpills.back().swap(queue.front());
+	    queue.pop_front();
+	    dropped = true;
+	} else {
+	    uint64_t begin = Profiler::Now();
+	    while (queue.size() >= capacity)
+		notFull.wait(lock);
+	    stats.blockedNs += Profiler::Now() - begin;
+	}
+    }
+
+    // reuse the buffer of an analyzed spill, it is already large enough
+    queue.push_back(vector<word_t>());
+    if (!freeSpills.empty()) {
+	queue.back().swap(freeSpills.back());
+	freeSpills.pop_back();
+    }
+    queue.back().assign(data, data + nWords);
+    if (queue.size() > stats.maxOccupancy)
+	stats.maxOccupancy = queue.size();
+
+    lock.unlock();
+    notEmpty.notify_one();
+    return !dropped;
+}
+
+size_t SpillQueue::GetOccupancy(void) const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return queue.size();
+}
+
+SpillQueue::Stats SpillQueue::GetStats(void) const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return stats;
+}
+
+/*! Print the fate of the spills received so far */
+void SpillQueue::Report(ostream &out) const
+{
+    Stats s = GetStats();
+    out << "live mode, " << GetPolicyName(policy) << " when full: "
+	<< s.pushed << " spills received, " << s.processed << " analyzed ("
+	<< s.decimated << " decimated), " << s.dropped << " dropped ("
+	<< s.droppedWords << " words), acquisition blocked "
+	<< 1e-9 * s.blockedNs << " s, at most " << s.maxOccupancy
+	<< " of " << capacity << " spills queued" << endl;
+}
+
+/*! Set policy from its name in the PIXIE_LIVE variable (block, drop or
+ *  decimate), false if it is unknown
+ */
+bool SpillQueue::ParsePolicy(const string &name, EPolicy &policy)
+{
+    if (name == "block")
+	policy = BLOCK;
+    else if (name == "drop")
+	policy = DROP_OLDEST;
+    else if (name == "decimate")
+	policy = DECIMATE;
+    else
+	return false;
+    return true;
+}
+
+const char* SpillQueue::GetPolicyName(EPolicy policy)
+{
+    switch (policy) {
+    case BLOCK:       return "block";
+    case DROP_OLDEST: return "drop oldest";
+    case DECIMATE:    return "decimate";
+    }
+    return "unknown";
+}
+
+/*! Analyze the spills in the order they came until stopped with an empty
+ *  queue
+ */
+void SpillQueue::Work(void)
+{
+    vector<word_t> spill;
+    unique_lock<mutex> lock(queueMutex);
+    while (true) {
+	while (!stop && queue.empty())
+	    notEmpty.wait(lock);
+	if (queue.empty())
+	    return;
+
+	double backlog = (policy == DECIMATE) ? double(queue.size()) / capacity : 0;
+	spill.swap(queue.front());
+	queue.pop_front();
+	lock.unlock();
+	notFull.notify_one();
+
+	bool decimated = !spill.empty() &&
+	    consumer(&spill[0], spill.size(), backlog);
+
+	lock.lock();
+	stats.processed++;
+	if (decimated)
+	    stats.decimated++;
+	freeSpills.push_back(vector<word_t>());
+	freeSpills.back().swap(spill);
+    }
+}
@@ -1,106 +1,288 @@
 /** \file StatsData.cpp
- *  \brief Stores statistics data from the data stream in its original format
+ *  \brief Decodes the statistics blocks from the data stream
  */
 
+#include <iomanip>
 #include <iostream>
 
 #include <cmath>
 #include <cstring>
 
-#include "param.h"
-#include "RawEvent.h"
-
-#include "pixie16app_defs.h"
+#include "damm_plotids.h"
+#include "StatsData.h"
 
 StatsData stats;
 
 using std::cout;
 using std::endl;
+using std::ostream;
+using std::setw;
 
 using pixie::word_t;
+using pixie::StatsLayout;
+
+/*! Addresses of the Pixie16 DSP output parameters, the same in the .var
+ *  files of the revision D and F firmware (Pixie16DSP_r15428.var and later).
+ *  The live time counts 16 system clocks up to revision D and every clock
+ *  from revision F on, the real time counts system clocks.
+ *
+ *  Revision A modules use the revision D addresses: pixie16app_defs.h gives
+ *  all revisions the same DSP parameter block (N_DSP_PAR, DSP_IO_BORDER,
+ *  DATA_MEMORY_ADDRESS), and the scan has always decoded the statistics of
+ *  every module with the r15428 addresses. No .var file of a revision A
+ *  firmware is at hand to check them against, if one differs its layout
+ *  belongs here.
+ */
+const StatsLayout& StatsLayout::Get(pixie::EFirmware firmware)
+{
+    static const size_t offset = 0x4a340; // DATA_MEMORY_ADDRESS + DSP_IO_BORDER
+    static const StatsLayout revD = {
+	0x4a340 - offset, 0x4a37f - offset, 0x4a39f - offset, 0x4a41f - offset,
+	1.0e-6 / SYSTEM_CLOCK_MHZ, 16.0e-6 / SYSTEM_CLOCK_MHZ};
+    static const StatsLayout revF = {
+	0x4a340 - offset, 0x4a37f - offset, 0x4a39f - offset, 0x4a41f - offset,
+	1.0e-6 / SYSTEM_CLOCK_MHZ, 1.0e-6 / SYSTEM_CLOCK_MHZ};
+
+    switch (firmware) {
+    case pixie::FIRMWARE_REVF:
+	return revF;
+    case pixie::FIRMWARE_REVA: // shares the revision D layout, see above
+    case pixie::FIRMWARE_REVD:
+    default:
+	return revD;
+    }
+}
 
 /** Clear the statistics data structures */
 StatsData::StatsData()
 {
-  cout << "Allocating " << sizeof(oldData) + sizeof(data) 
-       << " bytes for statistics data" << endl;
   bzero(oldData, sizeof(oldData));
   bzero(data, sizeof(data));
+  bzero(numBlocks, sizeof(numBlocks));
 }
 
-/** Copy the statistics data from the data stream to a memory block,
- *   preserving a copy of the old statistics data so that the incremental
- *   change can be determined */
- 
-void StatsData::DoStatisticsBlock(word_t *buf, int vsn)
+/** Decode the statistics block of a module from the data stream, keeping
+ *  the previous block so that the change over the interval can be
+ *  determined. A block repeating the last one is ignored. */
+void StatsData::DoStatisticsBlock(const word_t *buf, int vsn)
 {
-  if (memcmp(data[vsn], buf, sizeof(word_t)*statSize) != 0) {
-    memcpy(oldData[vsn], data[vsn], sizeof(word_t)*statSize);
-    memcpy(data[vsn], buf, sizeof(word_t)*statSize);    
+  if (vsn < 0 || size_t(vsn) >= maxVsn)
+    return;
+
+  ModuleStats block;
+  Decode(buf, readbuff::GetFirmware(vsn), block);
+  if (numBlocks[vsn] > 0 && block.realTime == data[vsn].realTime)
+    return;
+
+  if (block.realTime < data[vsn].realTime) {
+    // the counters restarted with a new run
+    bzero(&oldData[vsn], sizeof(oldData[vsn]));
+    numBlocks[vsn] = 0;
+  } else {
+    oldData[vsn] = data[vsn];
   }
+  data[vsn] = block;
+  numBlocks[vsn]++;
+
+  Plot(vsn);
 }
 
-/** Return the most recent statistics live time for a given id */
-double StatsData::GetCurrTime(unsigned int id) const
+/** A 64 bit counter from its high word at pos and its low word at pos+step */
+static inline double Counter(const word_t *buf, size_t pos, size_t step)
 {
-  // from Pixie15DSP_r15428.var  
-  const size_t offset = 0x4a340;
-  const size_t ltPosHi = 0x4a37f - offset;
-  const size_t ltPosLo = 0x4a38f - offset;
+  return buf[pos] * 4294967296. + buf[pos + step];
+}
 
-  int mod = id / NUMBER_OF_CHANNELS;
-  int ch  = id % NUMBER_OF_CHANNELS;
+/** Decode the counters of a statistics block with the layout of firmware */
+void StatsData::Decode(const word_t *buf, pixie::EFirmware firmware,
+		       ModuleStats &module)
+{
+  const StatsLayout &layout = StatsLayout::Get(firmware);
 
-  double d;
+  module.realTime = Counter(buf, layout.realTime, 1) * layout.realTick;
+  for (unsigned ch = 0; ch < NUMBER_OF_CHANNELS; ch++) {
+    ChannelStats &channel = module.channel[ch];
+    channel.liveTime = Counter(buf, layout.liveTime + ch, NUMBER_OF_CHANNELS) *
+      layout.liveTick;
+    channel.fastPeaks = Counter(buf, layout.fastPeaks + ch, NUMBER_OF_CHANNELS);
+    channel.outputCounts = Counter(buf, layout.chanEvents + ch,
+				   NUMBER_OF_CHANNELS);
+  }
+}
+
+/** Write the counters of module as a statistics block of statSize words of
+ *  firmware, the inverse of Decode() */
+void StatsData::Encode(const ModuleStats &module, pixie::EFirmware firmware,
+		       word_t *buf)
+{
+  const StatsLayout &layout = StatsLayout::Get(firmware);
+  const double wordRange = 4294967296.;
 
-  d = data[mod][ltPosHi + ch] * pow(2.0, 32);
-  d += data[mod][ltPosLo + ch];
+  bzero(buf, sizeof(word_t) * statSize);
 
-  d *= 16.0 * 1.0e-6 / SYSTEM_CLOCK_MHZ;
+  double realTime = floor(module.realTime / layout.realTick);
+  buf[layout.realTime] = word_t(realTime / wordRange);
+  buf[layout.realTime + 1] = word_t(fmod(realTime, wordRange));
 
-  return d;
+  for (unsigned ch = 0; ch < NUMBER_OF_CHANNELS; ch++) {
+    const ChannelStats &channel = module.channel[ch];
+    double counters[3] = {floor(channel.liveTime / layout.liveTick),
+			  channel.fastPeaks, channel.outputCounts};
+    size_t pos[3] = {layout.liveTime, layout.fastPeaks, layout.chanEvents};
+    for (unsigned i = 0; i < 3; i++) {
+      buf[pos[i] + ch] = word_t(counters[i] / wordRange);
+      buf[pos[i] + ch + NUMBER_OF_CHANNELS] = word_t(fmod(counters[i], wordRange));
+    }
+  }
 }
 
-/** Return the change in the number of fast peaks between the two most 
- *  recent statistics blocks for a given id */
-double StatsData::GetDiffPeaks(unsigned int id) const
+/** Declare the rate and dead time spectra filled at each block */
+void StatsData::DeclarePlots(void) const
+{
+  using namespace dammIds::misc;
+
+  DeclareHistogram2D(DD_INPUT_RATE, SC, S8, "input rate /s, x 10 s, y chan", 2);
+  DeclareHistogram2D(DD_OUTPUT_RATE, SC, S8, "output rate /s, x 10 s, y chan", 2);
+  DeclareHistogram2D(DD_DEAD_TIME, SC, S8, "dead time 0.1%, x 10 s, y chan");
+}
+
+/** Plot the rates and dead time of the channels of a module over the last
+ *  interval at the real time of the block */
+void StatsData::Plot(unsigned int mod) const
+{
+  using namespace dammIds::misc;
+
+  // the spectra are set, a zero would be taken for a 1D count by plot()
+  int x = int(data[mod].realTime / 10.);
+  for (unsigned ch = 0; ch < NUMBER_OF_CHANNELS; ch++) {
+    unsigned int id = mod * NUMBER_OF_CHANNELS + ch;
+    if (GetDiffPeaks(id) <= 0)
+      continue;
+    int inputRate = int(GetInputRate(id) + 0.5);
+    int outputRate = int(GetOutputRate(id) + 0.5);
+    int deadTime = int(1000 * GetDeadFraction(id) + 0.5);
+    if (inputRate > 0)
+      plot(DD_INPUT_RATE, x, id, inputRate);
+    if (outputRate > 0)
+      plot(DD_OUTPUT_RATE, x, id, outputRate);
+    if (deadTime > 0)
+      plot(DD_DEAD_TIME, x, id, deadTime);
+  }
+}
+
+/** Print the rates and dead time of each channel over the run */
+void StatsData::Report(ostream &out) const
+{
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+
+  bool header = false;
+  for (unsigned mod = 0; mod < maxVsn; mod++) {
+    if (numBlocks[mod] == 0)
+      continue;
+    const ModuleStats &module = data[mod];
+    for (unsigned ch = 0; ch < NUMBER_OF_CHANNELS; ch++) {
+      const ChannelStats &channel = module.channel[ch];
+      if (channel.fastPeaks == 0)
+	continue;
+      if (!header) {
+	out << "run statistics:   mod ch  real (s)  live (s)  input (/s) "
+	    << " output (/s)  dead (%)" << endl;
+	header = true;
+      }
+      double inputRate = (channel.liveTime > 0) ?
+	channel.fastPeaks / channel.liveTime : 0;
+      double outputRate = (module.realTime > 0) ?
+	channel.outputCounts / module.realTime : 0;
+      double dead = (inputRate > 0) ? 1 - outputRate / inputRate : 0;
+      out << std::fixed << std::setprecision(1)
+	  << "                  " << setw(3) << mod << setw(3) << ch
+	  << setw(10) << module.realTime << setw(10) << channel.liveTime
+	  << setw(12) << inputRate << setw(13) << outputRate
+	  << setw(10) << 100 * dead << endl;
+    }
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+/** Return the real time of a module at the most recent block */
+double StatsData::GetRealTime(unsigned int mod) const
 {
-  // from Pixie16DSP_r15428.var
-  const size_t offset = 0x4a340;
-  const size_t peaksPosHi = 0x4a39f - offset;
-  const size_t peaksPosLo = 0x4a3af - offset;
+  return data[mod].realTime;
+}
 
+/** Return the real time elapsed between the two most recent blocks of a
+ *  module */
+double StatsData::GetDiffRealTime(unsigned int mod) const
+{
+  return data[mod].realTime - oldData[mod].realTime;
+}
+
+/** Return the most recent statistics live time for a given id */
+double StatsData::GetCurrTime(unsigned int id) const
+{
   int mod = id / NUMBER_OF_CHANNELS;
   int ch  = id % NUMBER_OF_CHANNELS;
 
-  double d;
+  return data[mod].channel[ch].liveTime;
+}
 
-  d = data[mod][peaksPosHi + ch] - oldData[mod][peaksPosHi + ch];
-  d *= pow(2.0, 32);
-  d += data[mod][peaksPosLo + ch] - oldData[mod][peaksPosLo + ch];
+/** Return the change in the number of fast peaks between the two most
+ *  recent statistics blocks for a given id */
+double StatsData::GetDiffPeaks(unsigned int id) const
+{
+  int mod = id / NUMBER_OF_CHANNELS;
+  int ch  = id % NUMBER_OF_CHANNELS;
 
-  return d;
+  return data[mod].channel[ch].fastPeaks - oldData[mod].channel[ch].fastPeaks;
 }
 
-/** Return the elapsed live time between the two most recent statistics 
+/** Return the elapsed live time between the two most recent statistics
  *  blocks for a given channel */
 double StatsData::GetDiffTime(unsigned int id) const
 {
-  // from Pixie15DSP_r15428.var  
-  const size_t offset = 0x4a340;
-  const size_t ltPosHi = 0x4a37f - offset;
-  const size_t ltPosLo = 0x4a38f - offset;
+  int mod = id / NUMBER_OF_CHANNELS;
+  int ch  = id % NUMBER_OF_CHANNELS;
+
+  return data[mod].channel[ch].liveTime - oldData[mod].channel[ch].liveTime;
+}
 
+/** Return the change in the number of events written out between the two
+ *  most recent statistics blocks for a given id */
+double StatsData::GetDiffCounts(unsigned int id) const
+{
   int mod = id / NUMBER_OF_CHANNELS;
   int ch  = id % NUMBER_OF_CHANNELS;
 
-  double d;
+  return data[mod].channel[ch].outputCounts -
+    oldData[mod].channel[ch].outputCounts;
+}
 
-  d = data[mod][ltPosHi + ch] - oldData[mod][ltPosHi + ch];
-  d *= pow(2.0, 32);
-  d += data[mod][ltPosLo + ch] - oldData[mod][ltPosLo + ch];
+/** Return the input count rate of a channel, fast peaks per second of live
+ *  time, between the two most recent blocks */
+double StatsData::GetInputRate(unsigned int id) const
+{
+  double liveTime = GetDiffTime(id);
+  return (liveTime > 0) ? GetDiffPeaks(id) / liveTime : 0;
+}
 
-  d *= 16.0 * 1.0e-6 / SYSTEM_CLOCK_MHZ;
+/** Return the output count rate of a channel, events per second of real
+ *  time, between the two most recent blocks */
+double StatsData::GetOutputRate(unsigned int id) const
+{
+  double realTime = GetDiffRealTime(id / NUMBER_OF_CHANNELS);
+  return (realTime > 0) ? GetDiffCounts(id) / realTime : 0;
+}
 
-  return d;
+/** Return the fraction of the input lost by a channel between the two most
+ *  recent blocks, 1 - output rate / input rate as XIA defines it, so that
+ *  the pileup rejection counts with the time the channel is not live */
+double StatsData::GetDeadFraction(unsigned int id) const
+{
+  double inputRate = GetInputRate(id);
+  if (inputRate <= 0)
+    return 0;
+  double dead = 1 - GetOutputRate(id) / inputRate;
+  return (dead < 0) ? 0 : (dead > 1 ? 1 : dead);
 }
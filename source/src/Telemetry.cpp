@@ -0,0 +1,187 @@
+/** \file Telemetry.cpp
+ *  \brief Export of the scan counters in the Prometheus text format
+ */
+
+#include <fstream>
+
+#include <cstdio>
+
+#include "DetectorDriver.h"
+#include "Profiler.h"
+#include "SpillQueue.h"
+#include "Telemetry.h"
+#include "damm_plotids.h"
+
+using namespace std;
+
+extern DetectorDriver driver;
+extern SpillQueue spillQueue;
+
+namespace {
+    /// name and help of each counter
+    const char *counterNames[Telemetry::NUM_COUNTERS][2] = {
+	{"pixie_spills_total", "Spills reassembled from the acquisition"},
+	{"pixie_incomplete_spills_total",
+	 "Spills thrown away because chunks were missing"},
+	{"pixie_rejected_spills_total",
+	 "Reassembled spills failing the record sanity checks"},
+	{"pixie_missing_buffers_total",
+	 "Module buffers missing from the readout cycle"},
+	{"pixie_readout_errors_total", "Module buffers which could not be read"},
+	{"pixie_resyncs_total",
+	 "Resynchronizations on the next valid header after corrupt data"},
+	{"pixie_dropped_words_total",
+	 "Words skipped by the resynchronizations and bad event lengths"},
+	{"pixie_hits_total", "Channels decoded"},
+	{"pixie_events_total", "Events built and processed"}};
+
+    void Header(ostream &out, const char *name, const char *type,
+		const char *help)
+    {
+	out << "# HELP " << name << " " << help << "\n"
+	    << "# TYPE " << name << " " << type << "\n";
+    }
+}
+
+Telemetry::Telemetry() :
+    interval(0), start(0), lastWrite(0), lastHits(0), lastEvents(0),
+    lastPlots(0)
+{
+    for (unsigned i = 0; i < NUM_COUNTERS; i++)
+	counters[i] = 0;
+}
+
+/*! Write the metrics to fileName every interval seconds from now on, false
+ *  if the file can't be written
+ */
+bool Telemetry::Open(const string &fileName, double interval)
+{
+    this->fileName = fileName;
+    this->interval = uint64_t(interval * 1e9);
+    start = lastWrite = Profiler::Now();
+    if (!Write()) {
+	this->fileName.clear();
+	return false;
+    }
+    return true;
+}
+
+/*! Write the metrics if the interval has passed, called from the analysis
+ *  thread after each spill
+ */
+void Telemetry::Update(void)
+{
+    if (IsOpen() && Profiler::Now() - lastWrite >= interval)
+	Write();
+}
+
+/*! Replace the file by the current metrics */
+bool Telemetry::Write(void)
+{
+    if (!IsOpen())
+	return false;
+
+    string tmpName = fileName + ".tmp";
+    ofstream out(tmpName.c_str());
+    if (!out.good()) {
+	cout << "Can not write the telemetry to " << tmpName << endl;
+	return false;
+    }
+    WriteMetrics(out);
+    out.close();
+    if (!out.good() || rename(tmpName.c_str(), fileName.c_str()) != 0) {
+	cout << "Can not write the telemetry to " << fileName << endl;
+	return false;
+    }
+    return true;
+}
+
+/*! Write all the metrics, the rates are taken since the last call */
+void Telemetry::WriteMetrics(ostream &out)
+{
+    uint64_t now = Profiler::Now();
+    double elapsed = (now - lastWrite) * 1e-9;
+    uint64_t hits = Get(HITS), events = Get(EVENTS), plots = GetPlotCalls();
+
+    for (unsigned i = 0; i < NUM_COUNTERS; i++) {
+	Header(out, counterNames[i][0], "counter", counterNames[i][1]);
+	out << counterNames[i][0] << " " << Get(ECounter(i)) << "\n";
+    }
+    Header(out, "pixie_plots_total", "counter", "Histogram fills");
+    out << "pixie_plots_total " << plots << "\n";
+
+    Header(out, "pixie_hits_per_second", "gauge",
+	   "Channels decoded per second since the last update");
+    out << "pixie_hits_per_second "
+	<< (elapsed > 0 ? (hits - lastHits) / elapsed : 0) << "\n";
+    Header(out, "pixie_events_per_second", "gauge",
+	   "Events built per second since the last update");
+    out << "pixie_events_per_second "
+	<< (elapsed > 0 ? (events - lastEvents) / elapsed : 0) << "\n";
+    Header(out, "pixie_plots_per_second", "gauge",
+	   "Histogram fills per second since the last update");
+    out << "pixie_plots_per_second "
+	<< (elapsed > 0 ? (plots - lastPlots) / elapsed : 0) << "\n";
+    Header(out, "pixie_uptime_seconds", "gauge", "Time since the scan started");
+    out << "pixie_uptime_seconds " << (now - start) * 1e-9 << "\n";
+
+    // the scan stages and the event processors from the profiler
+    const string processorPrefix = "processor ";
+    Header(out, "pixie_stage_seconds_total", "counter",
+	   "Time spent in each stage of the scan");
+    for (unsigned i = 0; i < Profiler::NUM_STAGES; i++)
+	out << "pixie_stage_seconds_total{stage=\"" << profiler.GetName(i)
+	    << "\"} " << profiler.GetTotal(i) << "\n";
+    Header(out, "pixie_stage_calls_total", "counter",
+	   "Calls of each stage of the scan");
+    for (unsigned i = 0; i < Profiler::NUM_STAGES; i++)
+	out << "pixie_stage_calls_total{stage=\"" << profiler.GetName(i)
+	    << "\"} " << profiler.GetCount(i) << "\n";
+    Header(out, "pixie_processor_seconds_total", "counter",
+	   "Time spent in each event processor");
+    for (unsigned i = Profiler::NUM_STAGES; i < profiler.GetNumStages(); i++) {
+	const string &name = profiler.GetName(i);
+	if (name.compare(0, processorPrefix.size(), processorPrefix) == 0)
+	    out << "pixie_processor_seconds_total{processor=\""
+		<< name.substr(processorPrefix.size()) << "\"} "
+		<< profiler.GetTotal(i) << "\n";
+    }
+
+    Header(out, "pixie_spill_seconds", "summary",
+	   "Time to analyze a spill");
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    for (unsigned i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+	out << "pixie_spill_seconds{quantile=\"" << quantiles[i] << "\"} "
+	    << profiler.GetPercentile(Profiler::SPILL, quantiles[i]) << "\n";
+    out << "pixie_spill_seconds_sum " << profiler.GetTotal(Profiler::SPILL)
+	<< "\n"
+	<< "pixie_spill_seconds_count " << profiler.GetCount(Profiler::SPILL)
+	<< "\n";
+
+    // the live mode, the queue is kept in the last write after it stopped
+    Header(out, "pixie_shed_level", "gauge", "Load shedding level, 0 for none");
+    out << "pixie_shed_level " << driver.GetShedLevel() << "\n";
+    if (spillQueue.GetCapacity() > 0) {
+	SpillQueue::Stats queueStats = spillQueue.GetStats();
+	Header(out, "pixie_queue_depth", "gauge", "Spills waiting for analysis");
+	out << "pixie_queue_depth " << spillQueue.GetOccupancy() << "\n";
+	Header(out, "pixie_queue_capacity", "gauge",
+	       "Spills the live queue holds");
+	out << "pixie_queue_capacity " << spillQueue.GetCapacity() << "\n";
+	Header(out, "pixie_queue_dropped_spills_total", "counter",
+	       "Spills dropped from the full live queue");
+	out << "pixie_queue_dropped_spills_total " << queueStats.dropped << "\n";
+	Header(out, "pixie_queue_decimated_spills_total", "counter",
+	       "Spills analyzed with some work shed");
+	out << "pixie_queue_decimated_spills_total " << queueStats.decimated << "\n";
+	Header(out, "pixie_queue_blocked_seconds_total", "counter",
+	       "Time the acquisition waited for room in the queue");
+	out << "pixie_queue_blocked_seconds_total " << queueStats.blockedNs * 1e-9
+	    << "\n";
+    }
+
+    lastWrite = now;
+    lastHits = hits;
+    lastEvents = events;
+    lastPlots = plots;
+}
@@ -0,0 +1,143 @@
+/** \file TimingEngine.cpp
+ *  \brief Implementation of the high resolution time stamps
+ */
+
+#include <iostream>
+#include <sstream>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "RawEvent.h"
+#include "TimingEngine.h"
+
+using namespace std;
+
+/// the Rev. D CFD fraction has 15 bits per 10 ns clock tick
+const double TimingEngine::cfdScale = 32768.;
+const double TimingEngine::cfdFraction = 0.5;
+
+/*! The trace delays are taken from PIXIE_TRACE_DELAY */
+TimingEngine::TimingEngine() : numOnboard(0), numTrace(0)
+{
+    const char *delayVar = getenv("PIXIE_TRACE_DELAY");
+    if (delayVar != NULL && *delayVar != '\0' && !SetTraceDelays(delayVar))
+	cout << "Bad PIXIE_TRACE_DELAY '" << delayVar
+	     << "', use type:samples,... The traces are not timed." << endl;
+}
+
+/*! Set the trace delay of detector types from a list of type:samples
+ *  separated by commas, false if it can not be read. Init() has to be
+ *  called again for the channels to take them.
+ */
+bool TimingEngine::SetTraceDelays(const string &delays)
+{
+    vector<pair<string, double> > parsed;
+    istringstream in(delays);
+    string item;
+    while (getline(in, item, ',')) {
+	size_t colon = item.find(':');
+	if (colon == string::npos || colon == 0)
+	    return false;
+	char *end;
+	string value = item.substr(colon + 1);
+	double samples = strtod(value.c_str(), &end);
+	if (value.empty() || *end != '\0' || samples < 0)
+	    return false;
+	parsed.push_back(make_pair(item.substr(0, colon), samples));
+    }
+    typeDelays.swap(parsed);
+    return true;
+}
+
+/*! Look up the trace delay of each channel id from its detector type */
+void TimingEngine::Init(const vector<Identifier> &modChan)
+{
+    traceDelayOfId.assign(modChan.size(), -1.);
+    for (size_t id = 0; id < modChan.size(); id++) {
+	for (size_t i = 0; i < typeDelays.size(); i++) {
+	    if (modChan[id].GetType() == typeDelays[i].first)
+		traceDelayOfId[id] = typeDelays[i].second;
+	}
+    }
+}
+
+/*! Set the high resolution time of all the channels of a spill */
+void TimingEngine::Process(const vector<ChanEvent*> &eventList)
+{
+    for (vector<ChanEvent*>::const_iterator it = eventList.begin();
+	 it != eventList.end(); it++)
+	(*it)->SetHighResTime(Time(*it));
+}
+
+/*! High resolution time of a channel in clock ticks. The on-board CFD is
+ *  used when it is valid, otherwise the zero crossing of the digital CFD of
+ *  the trace taken from the trace delay of the channel. Without either the
+ *  time stamp is kept as is.
+ */
+double TimingEngine::Time(const ChanEvent *chan)
+{
+    double time = chan->GetTime();
+
+    if (chan->GetCfdValid()) {
+	numOnboard++;
+	return time + chan->GetCfdTime() / cfdScale;
+    }
+
+    const TraceView &trace = chan->GetTraceRef();
+    int id = chan->GetID();
+    if (trace.empty() || id < 0 || (size_t)id >= traceDelayOfId.size() ||
+	traceDelayOfId[id] < 0)
+	return time;
+
+    double crossing = TraceCfd(trace);
+    if (crossing < 0)
+	return time;
+
+    // the samples are taken on the same clock as the time stamp, which is
+    // the trigger at the trace delay
+    numTrace++;
+    return time + crossing - traceDelayOfId[id];
+}
+
+/*! Position in samples of the zero crossing of the digital CFD
+ *  (x[i - d] - b) - f * (x[i] - b) on the leading edge of the largest pulse,
+ *  found by linear interpolation between the two samples around it.
+ *  Returns -1 for traces too short or pulses too small.
+ */
+double TimingEngine::TraceCfd(const TraceView &trace)
+{
+    const int size = trace.size();
+    if (size <= baselineSamples + cfdDelay)
+	return -1;
+
+    const uint16_t *tr = trace.begin();
+
+    int sum = 0;
+    for (int i = 0; i < baselineSamples; i++)
+	sum += tr[i];
+    double baseline = double(sum) / baselineSamples;
+
+    int maxValue = tr[baselineSamples];
+    int maxPos = baselineSamples;
+    for (int i = baselineSamples; i < size; i++) {
+	if (tr[i] > maxValue) {
+	    maxValue = tr[i];
+	    maxPos = i;
+	}
+    }
+    if (maxValue - baseline < minAmplitude)
+	return -1;
+
+    // the CFD is positive once the delayed maximum is reached, walk back
+    // from there to where it turns negative on the leading edge
+    int start = maxPos + cfdDelay < size ? maxPos + cfdDelay : size - 1;
+    double last = (tr[start - cfdDelay] - baseline) - cfdFraction * (tr[start] - baseline);
+    for (int i = start - 1; i >= baselineSamples; i--) {
+	double cfd = (tr[i - cfdDelay] - baseline) - cfdFraction * (tr[i] - baseline);
+	if (cfd <= 0 && last > 0)
+	    return i + cfd / (cfd - last);
+	last = cfd;
+    }
+    return -1;
+}
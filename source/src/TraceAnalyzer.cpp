@@ -14,13 +14,14 @@
 #include <numeric>
 #include <vector>
 
+#include <cmath>
 #include <cstdlib>
 #include <unistd.h>
 
 #include "damm_plotids.h"
+#include "Profiler.h"
 #include "RandomPool.h"
 #include "RawEvent.h"
-#include "StatsAccumulator.h"
 #include "TraceAnalyzer.h"
 
 using namespace std;
@@ -55,6 +56,7 @@ int TraceAnalyzer::Init(const string &filterFile)
     energyFilter.reserve(maxTraceLength);
     thirdFilter.reserve(maxTraceLength);
     flt.reserve(maxTraceLength);
+    sums.reserve(maxTraceLength + 1);
 
     // read in the filter parameters
     ifstream in(filterFile.c_str());
@@ -94,10 +96,11 @@ int TraceAnalyzer::Init(const string &filterFile)
 /**
  * Set default filter parameters
  */
-TraceAnalyzer::TraceAnalyzer() : 
-    userTime(0.), systemTime(0.)
+TraceAnalyzer::TraceAnalyzer() : current(NULL), secondStart(0)
 {
-    clocksPerSecond = sysconf(_SC_CLK_TCK);
+    t1 = t2 = -1;
+    e1 = e2 = 0;
+
     fastRise = fastGap = 5;
     slowRise1 = slowGap1 = 100;
     //? these are some legacy values, are they appropriate
@@ -112,76 +115,188 @@ TraceAnalyzer::TraceAnalyzer() :
 TraceAnalyzer::~TraceAnalyzer() 
 {
     cout << "Trace processor : " 
-	 << userTime << " user time, "
-	 << systemTime << " system time" << endl;
+	 << profiler.GetTotal(Profiler::TRACE) << " s in "
+	 << profiler.GetCount(Profiler::TRACE) << " traces" << endl;
 }
 
 /**
- * Function to quickly analyze a trace online.  Trapezoidal filters
- * are run across the trace with varying parameters to extract E1
- * and E2 values and time differences
+ * Analyze the trace of a channel, computing only the requested products
+ * (a combination of ETraceProduct) which have not been computed for this
+ * channel yet. The results are stored in the trace info of the channel
+ * at the ETraceInfo slots, so asking again for a product costs nothing.
  *
- * This routine detects when the fast filter crosses its threshold,
- * verifies that the slower 3rd filter also is above its threshold,
- * and then samples the energy filter during its flattop.
- * detType and detSubtype not currently used
+ * The filters are trapezoidal filters run across the trace to extract E1
+ * and E2 values and time differences. The routine detects when the fast
+ * filter crosses its threshold, verifies that the slower 3rd filter also
+ * is above its threshold, and then samples the energy filter during its
+ * flattop. The search for a second pulse is only done for PILEUP.
  */
-int TraceAnalyzer::Analyze(const vector<int> &trace, 
-			   const string &detType, const string &detSubtype)
+int TraceAnalyzer::Analyze(ChanEvent *chan, unsigned products)
 {
-    tms tmsBegin;
-
-    times(&tmsBegin); // begin timing process
-    
-    average.clear();
-    fastFilter.clear();
-    energyFilter.clear();
-    thirdFilter.clear();
+    // products which rely on other ones
+    if (products & PLOTS)
+	products |= PILEUP;
+    if (products & PILEUP)
+	products |= FILTERS;
+    // the features all come from the same pass
+    if (products & FEATURES)
+	products |= FEATURES;
+
+    products &= ~chan->GetTraceDone();
+    if (products == 0)
+	return 0;
+
+    Profiler::Scope scope(Profiler::TRACE); // begin timing process
+
+    const TraceView &trace = chan->GetTraceRef();
+
+    if (products & FEATURES)
+	ExtractFeatures(trace, chan->GetTraceFeatures());
+    if ((products & ~FEATURES) == 0) {
+	chan->AddTraceDone(products);
+	return 0;
+    }
 
     // quick trace analysis adapted from previous scan versions in
     // the xia_trace99.f file.
     const int baseLow = 5, baseHigh = 35;
-    
-    StatsAccumulator stats = accumulate
-	(&trace[baseLow], &trace[baseHigh], StatsAccumulator());
-    double basel  = stats.GetMean();
-    // double sbasel = stats.GetStdDev();
-    // sigma not used
-
-    // make a trace of the running average
-    const int averageLen = 10;
-    // a lot of repeated arithmetic here too
-    for(int i = 0; i < (signed)(trace.size()-averageLen); i++) {
-      stats = accumulate
-	(&trace[i], &trace[i+averageLen], StatsAccumulator());
-      average.push_back(stats.GetMean() - basel);
+
+    if (trace.size() < (size_t)baseHigh) {
+	// too short to analyze, the trace info stays at -1
+	chan->AddTraceDone(products);
+	return 1;
     }
-    
+
+    // the filter buffers hold the last analyzed channel, a pileup search
+    // asked for afterwards needs them for this one again
+    if ((products & PILEUP) && current != chan)
+	products |= FILTERS;
+    current = chan;
+
+    // every window sum below is a difference of two running sums, so the
+    // average and all filters cost O(1) per sample whatever their length
+    FillSums(trace.begin(), trace.size());
+    const int *sum = &sums[0];
+    int high = trace.size();
+
+    double basel = (sum[baseHigh] - sum[baseLow]) / double(baseHigh - baseLow);
+
+    if (products & FILTERS) {
+	FindPulse(high);
+	chan->SetTraceInfo(INFO_TIME1, t1);
+	chan->SetTraceInfo(INFO_ENERGY1, e1);
+    }
+    if (products & PILEUP) {
+	FindSecondPulse();
+	chan->SetTraceInfo(INFO_TIME2, t2);
+	chan->SetTraceInfo(INFO_ENERGY2, e2);
+    }
+
+    if (products & PLOTS) {
+	// make a trace of the running average
+	const int averageLen = 10;
+	average.clear();
+	if (high > averageLen) {
+	    average.resize(high - averageLen);
+	    double *avg = &average[0];
+	    for (int i = 0; i < high - averageLen; i++)
+		avg[i] = (sum[i + averageLen] - sum[i]) / double(averageLen) - basel;
+	}
+	TracePlot(trace);
+    }
+
+    chan->AddTraceDone(products);
+    return 0;
+}
+
+/**
+ * Baseline, maximum, waveform QDC and saturation of a trace in a single
+ * pass. The maximum is searched for where the whole waveform window fits
+ * in the trace, traces too short for that keep the features unset.
+ */
+void TraceAnalyzer::ExtractFeatures(const TraceView &trace,
+				    TraceFeatures &features) const
+{
+    features.Zero();
+
+    const int size = trace.size();
+    if (size < (int)baselineSamples || size <= windowLow + windowHigh)
+	return;
+
+    const uint16_t *tr = trace.begin();
+    long long sum = 0, sumSq = 0;
+    unsigned int saturated = 0;
+    int maxValue = tr[windowLow];
+    int maxPos = windowLow;
+
+    for (int i = 0; i < (int)baselineSamples; i++) {
+	sum += tr[i];
+	sumSq += (long long)tr[i] * tr[i];
+    }
+
+    // the trace is scanned once for the saturation and the maximum, the
+    // loop is split where the search for the maximum begins and ends to
+    // keep it free of range checks
+    for (int i = 0; i < windowLow; i++)
+	saturated += (tr[i] >= saturation);
+    for (int i = windowLow; i < size - windowHigh; i++) {
+	saturated += (tr[i] >= saturation);
+	if (tr[i] > maxValue) {
+	    maxValue = tr[i];
+	    maxPos = i;
+	}
+    }
+    for (int i = size - windowHigh; i < size; i++)
+	saturated += (tr[i] >= saturation);
+
+    double baseline = sum / double(baselineSamples);
+    double variance = sumSq / double(baselineSamples) - baseline * baseline;
+
+    features.baseline = baseline;
+    features.stdDevBaseline = variance > 0 ? sqrt(variance) : 0;
+    features.maxValue = maxValue;
+    features.maxPos = maxPos;
+    features.saturated = saturated;
+
+    long long qdc = 0;
+    for (int i = maxPos - windowLow; i < maxPos + windowHigh; i++)
+	qdc += tr[i];
+    features.qdc = qdc - baseline * (windowLow + windowHigh);
+}
+
+/**
+ * Run the trapezoidal filters over the running sums of a trace of the
+ * given length and look for the first pulse
+ */
+void TraceAnalyzer::FindPulse(int high)
+{
+    const int baseHigh = 35;
+
+    t1 = t2 = -1;
+    e1 = e2 = 0;
+
     // determine trace filters, these are trapezoidal filters
     // characterized by a risetime and gaptime and a range of
     // the filter from lo to hi.
-    // filter(trace, lo, hi, gaptime, risetime);
-    int high = trace.size();
-
     int fastSize = 2 * fastRise + fastGap;
-    FilterFill(trace, fastFilter, fastSize, high, fastGap, fastRise);
+    FilterFromSums(fastFilter, fastSize, high, fastGap, fastRise);
 
     int slowSize1 = 2 * slowRise1 + slowGap1;
-    FilterFill(trace, energyFilter, slowSize1, high, slowGap1, slowRise1);
+    FilterFromSums(energyFilter, slowSize1, high, slowGap1, slowRise1);
 
     int slowSize2 = 2 * slowRise2 + slowGap2;
-    FilterFill(trace, thirdFilter, slowSize2, high, slowGap2, slowRise2);
+    FilterFromSums(thirdFilter, slowSize2, high, slowGap2, slowRise2);
 
     size_t sample; // point at which to sample the slow trace
     // find the point at which the trace crosses the threshold
-    t1 = -1;
-    e1 = 0;
-    
+
     vector<int>::iterator iThr  = fastFilter.begin() + baseHigh - fastSize;
     vector<int>::iterator iHigh = fastFilter.end(); 
 
     while (iThr < iHigh) {
       iThr = find_if(iThr, iHigh, bind2nd(greater<int>(), fastThresh));
+      if (iThr == iHigh)
+	break;
       // check that the correlated energy is sufficiently high
       t1 = iThr - fastFilter.begin();
       sample = t1 + (slowRise2 + slowGap2 / 2) - (fastRise + fastGap / 2);
@@ -192,16 +307,29 @@ int TraceAnalyzer::Analyze(const vector<int> &trace,
 	e1 /= slowRise1; 
       }
       // find the trailing edge
-      iThr += fastGap;
+      iThr += min<ptrdiff_t>(fastGap, iHigh - iThr);
       iThr = find_if(iThr, iHigh, bind2nd(less<int>(), fastThresh));
-      iThr += fastSize;
+      iThr += min<ptrdiff_t>(fastSize, iHigh - iThr);
     }
-    
-    
-    // find a second crossing point
+    secondStart = iThr - fastFilter.begin();
+}
+
+/**
+ * Look for a second pulse in the filters after the end of the first one
+ * found by FindPulse()
+ */
+void TraceAnalyzer::FindSecondPulse(void)
+{
+    int fastSize = 2 * fastRise + fastGap;
+    size_t sample;
+
     t2 = -1;
     e2 = 0;
-  
+
+    vector<int>::iterator iThr  = fastFilter.begin() + secondStart;
+    vector<int>::iterator iHigh = fastFilter.end(); 
+
+    // find a second crossing point
     if ( t1 != -1 && iThr < fastFilter.end() ) {
       while (iThr != iHigh) {
 	iThr = find_if(iThr, iHigh, bind2nd(greater<int>(), fastThresh));
@@ -216,18 +344,10 @@ int TraceAnalyzer::Analyze(const vector<int> &trace,
 	    // scale to the integration time
 	    e2 /= slowRise1;
 	  }
+	  break;
 	}
       }
     }
-
-  TracePlot(trace);
-  
-  tms tmsEnd;
-  times(&tmsEnd);
-  userTime += (tmsEnd.tms_utime - tmsBegin.tms_utime) / clocksPerSecond;
-  systemTime += (tmsEnd.tms_stime - tmsBegin.tms_stime) / clocksPerSecond; 
-
-  return(0);
 }
 
 /**
@@ -270,15 +390,47 @@ vector<int> TraceAnalyzer::Filter(vector<int> &trace, int lo, int hi,
  */
 void TraceAnalyzer::FilterFill(const vector<int> &trace, vector<int> &res,
 			int lo, int hi, int gapTime, int riseTime){
-    res.assign(lo, 0);
+    FillSums(trace.empty() ? NULL : &trace[0], trace.size());
+    FilterFromSums(res, lo, hi, gapTime, riseTime);
+}
 
-    for (int i = lo; i < hi; i++) {
-	int leftSum = accumulate(&trace[i - 2*riseTime - gapTime],
-				 &trace[i - riseTime - gapTime], 0);
-	int rightSum = accumulate(&trace[i - riseTime], &trace[i], 0);
+/**
+ * Running sums of the trace, sums[i] is the sum of the first i samples
+ */
+template<class T>
+void TraceAnalyzer::FillSums(const T *tr, size_t size)
+{
+    sums.resize(size + 1);
+    int *sum = &sums[0];
 
-	res.push_back(rightSum - leftSum);
-    }
+    sum[0] = 0;
+    for (size_t i = 0; i < size; i++)
+	sum[i + 1] = sum[i] + tr[i];
+}
+
+/**
+ * Trapezoidal filter from the running sums filled by FillSums(), each
+ * point is the difference of two window sums, which is a plain loop over
+ * the running sums that the compiler vectorizes
+ */
+void TraceAnalyzer::FilterFromSums(vector<int> &res, int lo, int hi,
+				   int gapTime, int riseTime)
+{
+    if (hi < lo)
+	hi = lo;
+    res.resize(hi);
+    if (hi == 0)
+	return;
+
+    int *r = &res[0];
+    const int *sum = &sums[0];
+    const int leftHigh = riseTime + gapTime;
+    const int leftLow = 2 * riseTime + gapTime;
+
+    for (int i = 0; i < lo; i++)
+	r[i] = 0;
+    for (int i = lo; i < hi; i++)
+	r[i] = (sum[i] - sum[i - riseTime]) - (sum[i - leftHigh] - sum[i - leftLow]);
 }
 
 /** declare the damm plots */
@@ -313,7 +465,7 @@ void TraceAnalyzer::DeclarePlots() const
  *   as well as  E2 v E1 and E2 v time difference plots with
  *   varying conditions for double pulses.
  */
-void TraceAnalyzer::TracePlot(const vector<int> &trace)
+void TraceAnalyzer::TracePlot(const TraceView &trace)
 			      
 {
     using namespace dammIds::trace;
@@ -0,0 +1,108 @@
+/** \file TraceCodec.cpp
+ *  \brief Implementation of the trace codec
+ */
+
+#include "TraceCodec.h"
+
+using namespace std;
+
+/*! Append the encoded trace to the output */
+void TraceCodec::Encode(const TraceView &trace, vector<uint8_t> &out)
+{
+    size_t size = trace.size();
+
+    // number of samples as a varint
+    size_t n = size;
+    do {
+	uint8_t byte = n & 0x7F;
+	n >>= 7;
+	out.push_back(n ? (byte | 0x80) : byte);
+    } while (n);
+
+    if (size == 0)
+	return;
+
+    const uint16_t *tr = trace.begin();
+    out.push_back(tr[0] & 0xFF);
+    out.push_back(tr[0] >> 8);
+
+    uint32_t block[blockSize];
+    for (size_t first = 1; first < size; first += blockSize) {
+	unsigned count = (size - first < blockSize) ? size - first : blockSize;
+
+	uint32_t all = 0;
+	for (unsigned i = 0; i < count; i++) {
+	    block[i] = ZigZag(int32_t(tr[first + i]) - int32_t(tr[first + i - 1]));
+	    all |= block[i];
+	}
+	unsigned width = 0;
+	while (all >> width)
+	    width++;
+	out.push_back(width);
+
+	// pack the bits, least significant first
+	uint64_t bits = 0;
+	unsigned numBits = 0;
+	for (unsigned i = 0; i < count; i++) {
+	    bits |= uint64_t(block[i]) << numBits;
+	    numBits += width;
+	    while (numBits >= 8) {
+		out.push_back(bits & 0xFF);
+		bits >>= 8;
+		numBits -= 8;
+	    }
+	}
+	if (numBits > 0)
+	    out.push_back(bits & 0xFF);
+    }
+}
+
+/*! Decode one trace from the input into samples, returns the number of
+ *  bytes read or 0 if the input is truncated or corrupt
+ */
+size_t TraceCodec::Decode(const uint8_t *in, size_t size,
+			  vector<uint16_t> &samples)
+{
+    size_t pos = 0;
+    size_t length = 0;
+    unsigned shift = 0;
+    do {
+	if (pos >= size || shift > 8 * sizeof(size_t))
+	    return 0;
+	length |= size_t(in[pos] & 0x7F) << shift;
+	shift += 7;
+    } while (in[pos++] & 0x80);
+
+    samples.resize(length);
+    if (length == 0)
+	return pos;
+
+    if (pos + 2 > size)
+	return 0;
+    samples[0] = in[pos] | (in[pos + 1] << 8);
+    pos += 2;
+
+    for (size_t first = 1; first < length; first += blockSize) {
+	unsigned count = (length - first < blockSize) ? length - first : blockSize;
+	if (pos >= size)
+	    return 0;
+	unsigned width = in[pos++];
+	if (width > 32 || pos + (count * width + 7) / 8 > size)
+	    return 0;
+
+	uint64_t bits = 0;
+	unsigned numBits = 0;
+	uint32_t mask = width < 32 ? (1u << width) - 1 : 0xFFFFFFFFu;
+	for (unsigned i = 0; i < count; i++) {
+	    while (numBits < width) {
+		bits |= uint64_t(in[pos++]) << numBits;
+		numBits += 8;
+	    }
+	    uint32_t value = uint32_t(bits) & mask;
+	    bits >>= width;
+	    numBits -= width;
+	    samples[first + i] = samples[first + i - 1] + UnZigZag(value);
+	}
+    }
+    return pos;
+}
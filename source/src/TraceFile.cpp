@@ -0,0 +1,107 @@
+/** \file TraceFile.cpp
+ *  \brief Writing of the compressed traces
+ */
+
+#include <algorithm>
+
+#include "Logger.h"
+#include "RawEvent.h"
+#include "TraceCodec.h"
+#include "TraceFile.h"
+
+using namespace std;
+
+const char TraceFile::magic[8] = {'P', 'X', 'T', 'R', 'A', 'C', 'E', '1'};
+
+TraceFile::TraceFile() :
+    numTraces(0), numFailed(0), rawBytes(0), fileBytes(0)
+{
+}
+
+TraceFile::~TraceFile()
+{
+    Close();
+}
+
+/*! Write the traces to fileName from now on, false if it can't be opened */
+bool TraceFile::Open(const string &fileName)
+{
+    Close();
+    file.open(fileName.c_str(), ios::binary | ios::trunc);
+    if (!file.good()) {
+	cout << "Can not write the traces to " << fileName << endl;
+	file.close();
+	return false;
+    }
+    this->fileName = fileName;
+    file.write(magic, sizeof(magic));
+    fileBytes = sizeof(magic);
+    return true;
+}
+
+/*! Append the trace of the channel, if it has one */
+void TraceFile::Write(const ChanEvent *chan)
+{
+    const TraceView &trace = chan->GetTraceRef();
+    if (!IsOpen() || trace.empty())
+	return;
+
+    encoded.clear();
+    TraceCodec::Encode(trace, encoded);
+
+    // check the round trip before anything is written
+    uint8_t isEncoded = 1;
+    decoded.clear();
+    if (TraceCodec::Decode(&encoded[0], encoded.size(), decoded) !=
+	    encoded.size() || decoded.size() != trace.size() ||
+	!equal(decoded.begin(), decoded.end(), trace.begin())) {
+	PIXIE_LOG(ERROR, "TraceFile: trace not restored by the codec",
+		  "channel " << chan->GetID() << ", written raw");
+	numFailed++;
+	isEncoded = 0;
+    }
+
+    uint32_t id = chan->GetID();
+    double time = chan->GetTime();
+    uint32_t size = isEncoded ? encoded.size() :
+	trace.size() * sizeof(uint16_t);
+
+    file.write(reinterpret_cast<const char *>(&id), sizeof(id));
+    file.write(reinterpret_cast<const char *>(&time), sizeof(time));
+    file.write(reinterpret_cast<const char *>(&isEncoded), sizeof(isEncoded));
+    file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    if (isEncoded)
+	file.write(reinterpret_cast<const char *>(&encoded[0]), size);
+    else
+	file.write(reinterpret_cast<const char *>(trace.begin()), size);
+
+    numTraces++;
+    rawBytes += trace.size() * sizeof(uint16_t);
+    fileBytes += sizeof(id) + sizeof(time) + sizeof(isEncoded) +
+	sizeof(size) + size;
+}
+
+/*! Flush and close the file */
+void TraceFile::Close(void)
+{
+    if (!IsOpen())
+	return;
+    file.close();
+    if (!file.good())
+	cout << "Can not write the traces to " << fileName << endl;
+}
+
+/*! Print the number of traces written and the compression achieved */
+void TraceFile::Report(ostream &out) const
+{
+    if (fileName.empty())
+	return;
+    out << numTraces << " traces written to " << fileName << ", "
+	<< fileBytes << " bytes for " << rawBytes << " bytes of samples";
+    if (numTraces > 0)
+	out << " (ratio " << double(rawBytes) / fileBytes << ")";
+    out << endl;
+    if (numFailed > 0)
+	out << "  " << numFailed << " traces not restored by the codec were "
+	    << "written raw" << endl;
+}
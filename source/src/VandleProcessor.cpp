@@ -454,7 +454,7 @@ VandleProcessor::VandleData::VandleData(ChanEvent *chan)
     stdDevBaseline = chan->GetStdDevBaseline();
     aveBaseline    = chan->GetAveBaseline();
     highResTime    = chan->GetPhase() + chan->GetTime();
-    trace          = chan->GetTraceRef();
+    trace.assign(chan->GetTraceRef().begin(), chan->GetTraceRef().end());
 }
 
 VandleProcessor::VandleBarData::VandleBarData(const VandleData& Right, const VandleData& Left, const double &distance)
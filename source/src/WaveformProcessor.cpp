@@ -1,6 +1,6 @@
 /************************************
 This code will obtain the phase of a trace
-using either a Chi^2 fitting routine in GSL, 
+using either a Chi^2 fit of a tabulated pulse shape,
 or a Single Point Analysis. 
 
 The data is passed into the raw event so that other
@@ -25,36 +25,22 @@ subroutines are able to access it.
 #include "damm_plotids.h"
 #include "DetectorDriver.h"
 #include "RawEvent.h"
+#include "TraceAnalyzer.h"
 #include "WaveformProcessor.h"
-#include "StatsAccumulator.h"
-
-#ifdef pulsefit
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_math.h>
-#include <gsl/gsl_blas.h>
-#include <gsl/gsl_fit.h>
-#include <gsl/gsl_multifit_nlin.h>
-#include <gsl/gsl_vector.h>
-#endif
 
 //A FEW MAGIC NUMBERS
 #define WID 3.9626     //define gaussian width for fit 3.9626
 #define DKAY 3.2334    //define decay constant for fit    3.2334
-#define WAVEFORMLOW  2  //The starting position of the Waveform (referenced from max)
-#define WAVEFORMHIGH 12 //The point when the Waveform returns to baseline (referenced from max)
+#define WAVEFORMLOW  TraceAnalyzer::windowLow  //The starting position of the Waveform (referenced from max)
+#define WAVEFORMHIGH TraceAnalyzer::windowHigh //The point when the Waveform returns to baseline (referenced from max)
 
 extern "C" void count1cc_(const int &, const int &, const int &);
 extern "C" void set2cc_(const int &, const int &, const int &, const int &);
 
-void ngdiscrim(const vector<int> &trace, const double &traceQDC, const double &ave_baseline, const int &maxX);
+void ngdiscrim(const TraceView &trace, const double &traceQDC, const double &ave_baseline, const int &maxX);
 
-#ifdef pulsefit
-double fitroutine(const vector<int> &trace, const int &maxX, const double &ave_baseline, const double &s_dev_baseline);
-int my_f(const gsl_vector *x, void *FitData, gsl_vector *f);
-int expb_df(const gsl_vector *x, void *FitData, gsl_matrix *J);
-int expb_fdf(const gsl_vector *x, void *FitData, gsl_vector *f, gsl_matrix *J);
-#else
-double spt_analysis(const vector<int> &trace, const int &maxX, const double &ave_baseline, const double &trcQDC, const int &counter);
+#ifndef pulsefit
+double spt_analysis(const TraceView &trace, const int &maxX, const double &ave_baseline, const double &trcQDC, const int &counter);
 #endif
 
 using namespace dammIds::waveformprocessor;
@@ -64,10 +50,18 @@ WaveformProcessor::WaveformProcessor(): EventProcessor()
 {
     name = "FittingRoutine";
     associatedTypes.insert("scint"); 
+    priority = PRIORITY_LOW;
+    cost = COST_HIGH; // fits of the traces
     associatedTypes.insert("vandle");
     associatedTypes.insert("pulser");
 
+    // baseline, maximum and QDC are extracted once by the driver
+    traceProducts = TraceAnalyzer::FEATURES;
+
     counter = 0;
+#ifdef pulsefit
+    MakeTemplate();
+#endif
 }
 
 void WaveformProcessor::DeclarePlots(void) const
@@ -103,7 +97,7 @@ bool WaveformProcessor::Process(RawEvent &event)
 	ChanEvent *chan = *it;
 	const unsigned int location = chan->GetChanID().GetLocation();
 	const string subType = chan->GetChanID().GetSubtype();
-	const vector<int> &trace = chan->GetTraceRef();
+	const TraceView &trace = chan->GetTraceRef();
 	
        	//initalize the variables to be passed to RawEvent
 	chan->SetTrcQDC(-9999);
@@ -113,40 +107,22 @@ bool WaveformProcessor::Process(RawEvent &event)
 	chan->SetAveBaseline(-9999);
 	chan->SetMaxPos(-9999);
 	
-	int satTraceCount = count(trace.begin(),trace.end(),4095);
+	if(trace.empty()) //SKIP IF NO TRACE
+	    continue;
+
+/**** PEAK, BASELINE AND QDC FROM THE SHARED TRACE FEATURES ****/
+	extern DetectorDriver driver;
+	driver.AnalyzeTrace(chan, TraceAnalyzer::FEATURES);
+	const TraceFeatures &features = chan->GetTraceFeatures();
 
-	if(trace.empty()|| (satTraceCount > 0)) //SKIP IF NO TRACE OR SATURATION
+	if(features.maxPos < 0 || features.saturated > 0) //SKIP IF TOO SHORT OR SATURATION
 	    continue;
-	
-/**** LOCATE THE WAVEFORM PEAK ****/
-	vector<int>::const_iterator itTrace = max_element(trace.begin()+WAVEFORMLOW, trace.end()-WAVEFORMHIGH);
-	double max_value = *itTrace;
-	int max_x = int(itTrace-trace.begin());
-
-/**** CALCULATE THE AVERAGE AND S_DEV OF THE BASELINE (REPLACE WITH STATS ACCUMULATOR) ****/	    
-	double sumOfBaseline = 0, baselineOffset = 0;
-	int numBinsBaseline = 15;
-	
-	for (unsigned int v=0; v < numBinsBaseline; v++) 
-	{
-	    unsigned int baselineValue = trace.at(int(v + baselineOffset));
-	    sumOfBaseline += baselineValue;
-	}
-	
-	double aveBaseline = sumOfBaseline / numBinsBaseline;
-	double stdDevSum = 0;
-	
-	for (unsigned int z=0; z < numBinsBaseline; z++) 
-	{
-	    unsigned int baselineValue = trace.at(z); 
-	    stdDevSum  += (baselineValue - aveBaseline) * (baselineValue - aveBaseline);
-	}
-	double stdDevBaseline = sqrt((1/double(numBinsBaseline))*stdDevSum);
-	
-/**** GET THE QDC VALUE OF THE WAVEFORM ****/
-	double traceQDC=0;
-	for(unsigned int j = (max_x - WAVEFORMLOW); (j < (max_x + WAVEFORMHIGH)) && (j < trace.size()); j++)
-	    traceQDC += (trace.at(j)-aveBaseline);
+
+	double max_value = features.maxValue;
+	int max_x = features.maxPos;
+	double aveBaseline = features.baseline;
+	double stdDevBaseline = features.stdDevBaseline;
+	double traceQDC = features.qdc;
 	
 /**** N-GAMMA DISCRIMINATION ****/
 	if(subType == "liquid")
@@ -157,7 +133,7 @@ bool WaveformProcessor::Process(RawEvent &event)
 	    chan->SetStdDevBaseline(stdDevBaseline);
 	    chan->SetAveBaseline(aveBaseline);
 #ifdef pulsefit
-	    chan->SetPhase(fitroutine(trace, max_x, aveBaseline, stdDevBaseline));
+	    chan->SetPhase(FitPhase(trace, max_x, aveBaseline));
 #else
 	    chan->SetPhase(spt_analysis(trace, max_x, aveBaseline, traceQDC, counter));
 #endif
@@ -171,7 +147,7 @@ bool WaveformProcessor::Process(RawEvent &event)
     return(true);
 }
 
-void ngdiscrim(const vector<int> &trace, const double &traceQDC, const double &aveBaseline, const int &maxX)
+void ngdiscrim(const TraceView &trace, const double &traceQDC, const double &aveBaseline, const int &maxX)
 {
     double discrim = 0, discrim_norm = 0;
     
@@ -185,141 +161,79 @@ void ngdiscrim(const vector<int> &trace, const double &traceQDC, const double &a
 }
 
 #ifdef pulsefit
-double fitroutine(const vector<int> &trace, const int &maxX, const double &aveBaseline, const double &stdDevBaseline)
+/**
+ * Sample the fixed pulse shape of the fit every 1/phaseSteps of a sample
+ * over all the offsets the phase search can ask for, so that fitting a
+ * trace needs table lookups only
+ */
+void WaveformProcessor::MakeTemplate(void)
 {
-    vector<double> trace_array_fit;
-        
-    for(int ll = (maxX-WAVEFORMLOW); ll <= (maxX+WAVEFORMHIGH); ll++)
-	trace_array_fit.push_back(trace.at(ll) - aveBaseline);
-    
-    const int size_fit = trace_array_fit.size();
-    
-    const gsl_multifit_fdfsolver_type *T;
-    gsl_multifit_fdfsolver *s;
-    int status;
-    unsigned int iter = 0;
-    const size_t numParams = 2;
-        
-    gsl_matrix *covar = gsl_matrix_alloc (numParams, numParams);
-    double y[size_fit], sigma[size_fit];
-    struct WaveformProcessor::FitData d = {size_fit, y, sigma};
-    gsl_multifit_function_fdf f;
-    double x_init[numParams] = {2, trace.at(maxX)-aveBaseline};
-    gsl_vector_view x = gsl_vector_view_array (x_init, numParams);
-    
-    f.f = &my_f;
-    f.df = &expb_df;
-    f.fdf = &expb_fdf;
-    f.n = size_fit;
-    f.p = numParams;
-    f.params = &d;
-    
-    for(int b = 0; b < size_fit; b++)
-    {
-	y[b] = trace_array_fit.at(b);
-	sigma[b] = stdDevBaseline;
-    }
-    
-    T = gsl_multifit_fdfsolver_lmsder;
-    s = gsl_multifit_fdfsolver_alloc (T, size_fit, numParams);
-    gsl_multifit_fdfsolver_set (s, &f, &x.vector);
-    
-    do
-    {
-	iter++;
-	
-	status = gsl_multifit_fdfsolver_iterate(s);
-	
-	if (status)
-	    break;
-	
-	status = gsl_multifit_test_delta (s->dx, s->x,
-					  0.001, 0.001);
-    }
-    while ((status == GSL_CONTINUE) && (iter < 1000000));
-    
-    gsl_multifit_covar (s->J, 0.0, covar);
-    
-    double fit_results[2];
-    for(int i=0; i < 2; i++)
-	fit_results[i] = gsl_vector_get(s->x,i);
-
-    gsl_multifit_fdfsolver_free (s);
-    gsl_matrix_free (covar);
-
-    return (fit_results[0]+maxX);
-}
-
-int my_f (const gsl_vector * x, void *FitData, gsl_vector * f)
-{
-    size_t n = ((struct WaveformProcessor::FitData *)FitData)->n;
-    double *y = ((struct WaveformProcessor::FitData *)FitData)->y;
-    double *sigma = ((struct WaveformProcessor::FitData *)FitData)->sigma;
-
-    double alpha = gsl_vector_get (x,0);
-    double beta = gsl_vector_get (x, 1);
-
-    for(size_t i = 0; i < n; i++)
-    {
-	double t = i;
-	double Yi = 0;
+    const int numPoints = WAVEFORMLOW + WAVEFORMHIGH + 1;
+    const int size = (numPoints - phaseLow) * phaseSteps + 1;
 
-	if(t < alpha)
-	    Yi = 0;
-	else
-	    Yi = beta*(1-exp(-((t-alpha)*(t-alpha))/WID))*exp(-(t-alpha)/DKAY);
-
-	gsl_vector_set (f, i, (Yi - y[i])/sigma[i]);
-     }
-    return GSL_SUCCESS;
+    pulseTemplate.resize(size);
+    for (int j = 0; j < size; j++) {
+	double t = double(j) / phaseSteps;
+	pulseTemplate[j] = (1 - exp(-t*t/WID)) * exp(-t/DKAY);
+    }
+    fitTrace.reserve(numPoints);
+    phaseScore.reserve((phaseHigh - phaseLow) * phaseSteps + 1);
 }
 
-int expb_df (const gsl_vector * x, void *FitData, gsl_matrix * J)
+/**
+ * Fit the phase and amplitude of the pulse shape to the waveform window.
+ * For a given phase the best amplitude is linear, A/B with A = sum(y*f)
+ * and B = sum(f*f), leaving a chi^2 of sum(y*y) - A*A/B. The phase
+ * maximizing A*A/B is searched on the template grid, then refined by a
+ * Newton step on the neighbouring grid points. The baseline deviation is
+ * the same for all points and so drops out of the fit.
+ */
+double WaveformProcessor::FitPhase(const TraceView &trace, int maxX,
+				   double aveBaseline)
 {
-    size_t n = ((struct WaveformProcessor::FitData *)FitData)->n;
-    double *sigma = ((struct WaveformProcessor::FitData *) FitData)->sigma;
-  
-    double alpha = gsl_vector_get (x, 0);
-    double beta = gsl_vector_get (x, 1);
-
-    double dalf, dbet;
-    
-    for (size_t i = 0; i < n; i++)
-    {
-	/* Jacobian matrix J(i,j) = dfi / dxj, */
-	/* where fi = (Yi - yi)/sigma[i],      */
-	/*       Yi = A * exp(-beta * i) + b  */
-	/* and the xj are the parameters (A,beta,b) */
- 	double t = i;
- 	double s = sigma[i];
-	
-	if(t < alpha)
-	{
-	    dbet = 0;
-	    dalf = 0;
-	}
-	else
-	{
-	    dbet = (1-exp(-(t-alpha)*(t-alpha)/WID))*exp(-(t-alpha)/DKAY);
-	    dalf = beta*exp(-(t-alpha)/DKAY)*((1-exp(-(t-alpha)*(t-alpha)/WID))/DKAY - (2*(t-alpha)/WID)*exp(-(t-alpha)*(t-alpha)/WID));
+    const int numPoints = WAVEFORMLOW + WAVEFORMHIGH + 1;
+    const int numPhases = (phaseHigh - phaseLow) * phaseSteps + 1;
+
+    fitTrace.resize(numPoints);
+    for (int i = 0; i < numPoints; i++)
+	fitTrace[i] = trace.at(maxX - WAVEFORMLOW + i) - aveBaseline;
+
+    phaseScore.assign(numPhases, 0);
+    int best = -1;
+    for (int k = 0; k < numPhases; k++) {
+	// template index of the first point for the phase phaseLow + k/phaseSteps
+	int j = -phaseLow * phaseSteps - k;
+	double a = 0, b = 0;
+	for (int i = 0; i < numPoints; i++, j += phaseSteps) {
+	    if (j <= 0)
+		continue;
+	    double f = pulseTemplate[j];
+	    a += fitTrace[i] * f;
+	    b += f * f;
 	}
+	if (a > 0 && b > 0)
+	    phaseScore[k] = a * a / b;
+	if (phaseScore[k] > 0 && (best < 0 || phaseScore[k] > phaseScore[best]))
+	    best = k;
+    }
 
-	gsl_matrix_set (J,i,0, dalf/s);
-	gsl_matrix_set (J,i,1, dbet/s);
+    if (best < 0)
+	return -9999;
+
+    double step = best;
+    if (best > 0 && best < numPhases - 1) {
+	double s0 = phaseScore[best - 1];
+	double s1 = phaseScore[best];
+	double s2 = phaseScore[best + 1];
+	double curvature = s0 - 2 * s1 + s2;
+	if (curvature < 0)
+	    step += min(0.5, max(-0.5, 0.5 * (s0 - s2) / curvature));
     }
-    return GSL_SUCCESS;
-}
 
-int expb_fdf (const gsl_vector * x, void *FitData,
-	  gsl_vector * f, gsl_matrix * J)
-{
-    my_f (x, FitData, f);
-    expb_df (x, FitData, J);
-    
-    return GSL_SUCCESS;
+    return (phaseLow + step / phaseSteps + maxX);
 }
 #else
-double spt_analysis(const vector<int> &trace, const int &maxX, const double &ave_baseline, const double &trcQDC, const int &counter)
+double spt_analysis(const TraceView &trace, const int &maxX, const double &ave_baseline, const double &trcQDC, const int &counter)
 {
     //Normalize the trace
     vector<double> normtrc(trace.size());